@@ -0,0 +1,70 @@
+#pragma once
+
+// Generated by AtlasPacker.cpp from:
+//   Ball.png
+//   numbers/0.png
+//   numbers/1.png
+//   numbers/2.png
+//   numbers/3.png
+//   numbers/4.png
+//   numbers/5.png
+//   numbers/6.png
+//   numbers/7.png
+//   numbers/8.png
+//   numbers/9.png
+// Don't edit by hand; rerun the packer.
+
+static const char* const ATLAS_FILE = "atlas.png";
+static const int ATLAS_WIDTH = 128;
+static const int ATLAS_HEIGHT = 256;
+
+enum AtlasSprite {
+	ATLAS_BALL,
+	ATLAS_DIGIT_0,
+	ATLAS_DIGIT_1,
+	ATLAS_DIGIT_2,
+	ATLAS_DIGIT_3,
+	ATLAS_DIGIT_4,
+	ATLAS_DIGIT_5,
+	ATLAS_DIGIT_6,
+	ATLAS_DIGIT_7,
+	ATLAS_DIGIT_8,
+	ATLAS_DIGIT_9,
+	ATLAS_SPRITE_COUNT
+};
+
+// Pixels from the top left, and the same as UVs with v running down from
+// the top row. Flip v for a renderer that loads textures bottom row first.
+struct AtlasRect {
+	int x, y, width, height;
+	float u0, v0, u1, v1;
+};
+
+static const AtlasRect ATLAS_RECTS[ATLAS_SPRITE_COUNT] = {
+	{    1,    1,  100,  100, 0.007812f, 0.003906f, 0.789062f, 0.394531f }, // BALL
+	{    1,  103,   35,   35, 0.007812f, 0.402344f, 0.281250f, 0.539062f }, // DIGIT_0
+	{   38,  103,   35,   35, 0.296875f, 0.402344f, 0.570312f, 0.539062f }, // DIGIT_1
+	{   75,  103,   35,   35, 0.585938f, 0.402344f, 0.859375f, 0.539062f }, // DIGIT_2
+	{    1,  140,   35,   35, 0.007812f, 0.546875f, 0.281250f, 0.683594f }, // DIGIT_3
+	{   38,  140,   35,   35, 0.296875f, 0.546875f, 0.570312f, 0.683594f }, // DIGIT_4
+	{   75,  140,   35,   35, 0.585938f, 0.546875f, 0.859375f, 0.683594f }, // DIGIT_5
+	{    1,  177,   35,   35, 0.007812f, 0.691406f, 0.281250f, 0.828125f }, // DIGIT_6
+	{   38,  177,   35,   35, 0.296875f, 0.691406f, 0.570312f, 0.828125f }, // DIGIT_7
+	{   75,  177,   35,   35, 0.585938f, 0.691406f, 0.859375f, 0.828125f }, // DIGIT_8
+	{    1,  214,   35,   35, 0.007812f, 0.835938f, 0.281250f, 0.972656f }, // DIGIT_9
+};
+
+// The files each sprite came from, for loading them one by one instead
+static const char* const ATLAS_SOURCES[ATLAS_SPRITE_COUNT] = {
+	"Ball.png",
+	"numbers/0.png",
+	"numbers/1.png",
+	"numbers/2.png",
+	"numbers/3.png",
+	"numbers/4.png",
+	"numbers/5.png",
+	"numbers/6.png",
+	"numbers/7.png",
+	"numbers/8.png",
+	"numbers/9.png",
+};
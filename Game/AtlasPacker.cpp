@@ -0,0 +1,422 @@
+// Offline sprite atlas packer. Merges 8-bit RGB/RGBA PNGs into one atlas PNG
+// and writes a header with where each sprite ended up, e.g.
+//
+//   g++ -O2 -std=c++17 AtlasPacker.cpp -lz -o atlas_packer
+//   ./atlas_packer atlas.png Atlas.h BALL=Ball.png DIGIT_0=numbers/0.png ... DIGIT_9=numbers/9.png
+//   ./atlas_packer check [atlas.png]
+//
+// Sprites keep the order given, so ones listed together (the digits) can be
+// indexed off the first. Every sprite gets a one pixel border copied from its
+// own edge, so filtering at the edge of a rect never picks up a neighbour.
+// `check` goes over atlas.png against the Atlas.h the packer was built with,
+// so rebuild it after repacking. Run it from the Game folder.
+
+#include "Atlas.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct Image {
+	int width = 0;
+	int height = 0;
+	// RGBA, top row first
+	std::vector<uint8_t> pixels;
+};
+
+static const uint8_t PNG_SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+static const int PADDING = 1;
+
+static uint32_t readBE(const uint8_t* in) {
+	return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | in[3];
+}
+
+static void writeBE(std::vector<uint8_t>& out, uint32_t value) {
+	out.push_back((uint8_t)(value >> 24));
+	out.push_back((uint8_t)(value >> 16));
+	out.push_back((uint8_t)(value >> 8));
+	out.push_back((uint8_t)value);
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>& data) {
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		return false;
+	}
+	uint8_t buffer[4096];
+	size_t got;
+	while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		data.insert(data.end(), buffer, buffer + got);
+	}
+	fclose(file);
+	return true;
+}
+
+static int paeth(int a, int b, int c) {
+	int p = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+	if (pa <= pb && pa <= pc) {
+		return a;
+	}
+	return pb <= pc ? b : c;
+}
+
+// Only what our art uses: 8 bits a channel, RGB or RGBA, not interlaced
+static bool loadPNG(const char* path, Image& image) {
+	std::vector<uint8_t> data;
+	if (!readFile(path, data) || data.size() < 8 || memcmp(data.data(), PNG_SIGNATURE, 8) != 0) {
+		fprintf(stderr, "%s: not a PNG\n", path);
+		return false;
+	}
+
+	int channels = 0;
+	std::vector<uint8_t> compressed;
+	for (size_t at = 8; at + 12 <= data.size();) {
+		uint32_t length = readBE(&data[at]);
+		const uint8_t* type = &data[at + 4];
+		const uint8_t* body = &data[at + 8];
+		if (at + 12 + length > data.size()) {
+			break;
+		}
+		if (memcmp(type, "IHDR", 4) == 0) {
+			image.width = (int)readBE(body);
+			image.height = (int)readBE(body + 4);
+			int depth = body[8];
+			int color = body[9];
+			int interlace = body[12];
+			if (depth != 8 || (color != 2 && color != 6) || interlace != 0) {
+				fprintf(stderr, "%s: needs 8-bit RGB or RGBA without interlacing\n", path);
+				return false;
+			}
+			channels = color == 6 ? 4 : 3;
+		}
+		else if (memcmp(type, "IDAT", 4) == 0) {
+			compressed.insert(compressed.end(), body, body + length);
+		}
+		else if (memcmp(type, "IEND", 4) == 0) {
+			break;
+		}
+		at += 12 + length;
+	}
+	if (channels == 0) {
+		fprintf(stderr, "%s: no IHDR\n", path);
+		return false;
+	}
+
+	size_t stride = (size_t)image.width * channels;
+	std::vector<uint8_t> raw((stride + 1) * image.height);
+	uLongf raw_size = (uLongf)raw.size();
+	if (uncompress(raw.data(), &raw_size, compressed.data(), (uLong)compressed.size()) != Z_OK || raw_size != raw.size()) {
+		fprintf(stderr, "%s: bad image data\n", path);
+		return false;
+	}
+
+	// Undo the per-row filters in place, then widen to RGBA
+	image.pixels.resize((size_t)image.width * image.height * 4);
+	std::vector<uint8_t> previous(stride, 0);
+	for (int y = 0; y < image.height; y++) {
+		uint8_t filter = raw[y * (stride + 1)];
+		uint8_t* row = &raw[y * (stride + 1) + 1];
+		for (size_t x = 0; x < stride; x++) {
+			int left = x >= (size_t)channels ? row[x - channels] : 0;
+			int up = previous[x];
+			int up_left = x >= (size_t)channels ? previous[x - channels] : 0;
+			switch (filter) {
+			case 0: break;
+			case 1: row[x] += left; break;
+			case 2: row[x] += up; break;
+			case 3: row[x] += (left + up) / 2; break;
+			case 4: row[x] += paeth(left, up, up_left); break;
+			default:
+				fprintf(stderr, "%s: bad filter %d\n", path, filter);
+				return false;
+			}
+		}
+		for (int x = 0; x < image.width; x++) {
+			uint8_t* out = &image.pixels[((size_t)y * image.width + x) * 4];
+			out[0] = row[x * channels + 0];
+			out[1] = row[x * channels + 1];
+			out[2] = row[x * channels + 2];
+			out[3] = channels == 4 ? row[x * channels + 3] : 255;
+		}
+		memcpy(previous.data(), row, stride);
+	}
+	return true;
+}
+
+static void writeChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& body) {
+	writeBE(out, (uint32_t)body.size());
+	size_t type_at = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), body.begin(), body.end());
+	writeBE(out, (uint32_t)crc32(0, &out[type_at], (uInt)(body.size() + 4)));
+}
+
+static bool savePNG(const char* path, const Image& image) {
+	// No filtering; the atlas is mostly empty space and flat colour anyway
+	size_t stride = (size_t)image.width * 4;
+	std::vector<uint8_t> raw;
+	raw.reserve((stride + 1) * image.height);
+	for (int y = 0; y < image.height; y++) {
+		raw.push_back(0);
+		raw.insert(raw.end(), &image.pixels[y * stride], &image.pixels[y * stride] + stride);
+	}
+	uLongf compressed_size = compressBound((uLong)raw.size());
+	std::vector<uint8_t> compressed(compressed_size);
+	if (compress2(compressed.data(), &compressed_size, raw.data(), (uLong)raw.size(), 9) != Z_OK) {
+		return false;
+	}
+	compressed.resize(compressed_size);
+
+	std::vector<uint8_t> header;
+	writeBE(header, image.width);
+	writeBE(header, image.height);
+	header.push_back(8); // Bits a channel
+	header.push_back(6); // RGBA
+	header.push_back(0);
+	header.push_back(0);
+	header.push_back(0);
+
+	std::vector<uint8_t> png(PNG_SIGNATURE, PNG_SIGNATURE + 8);
+	writeChunk(png, "IHDR", header);
+	writeChunk(png, "IDAT", compressed);
+	writeChunk(png, "IEND", {});
+
+	FILE* file = fopen(path, "wb");
+	if (!file) {
+		return false;
+	}
+	bool ok = fwrite(png.data(), 1, png.size(), file) == png.size();
+	return fclose(file) == 0 && ok;
+}
+
+struct Sprite {
+	std::string name;
+	std::string path;
+	Image image;
+	// Where the sprite itself (not its border) went
+	int x = 0;
+	int y = 0;
+};
+
+static int nextPowerOfTwo(int value) {
+	int power = 1;
+	while (power < value) {
+		power *= 2;
+	}
+	return power;
+}
+
+// Shelf packing, tallest first. Tries each power of two width from the
+// narrowest that could work and keeps whichever wastes least.
+static void pack(std::vector<Sprite>& sprites, int& atlas_width, int& atlas_height) {
+	std::vector<int> order(sprites.size());
+	int widest = 0;
+	for (size_t i = 0; i < sprites.size(); i++) {
+		order[i] = (int)i;
+		widest = std::max(widest, sprites[i].image.width + 2 * PADDING);
+	}
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+		return sprites[a].image.height > sprites[b].image.height;
+	});
+
+	int best_area = 0;
+	for (int width = nextPowerOfTwo(widest); width <= 8192; width *= 2) {
+		int x = 0;
+		int y = 0;
+		int shelf = 0;
+		std::vector<int> xs(sprites.size());
+		std::vector<int> ys(sprites.size());
+		for (int i : order) {
+			int w = sprites[i].image.width + 2 * PADDING;
+			int h = sprites[i].image.height + 2 * PADDING;
+			if (x + w > width) {
+				x = 0;
+				y += shelf;
+				shelf = 0;
+			}
+			xs[i] = x + PADDING;
+			ys[i] = y + PADDING;
+			x += w;
+			shelf = std::max(shelf, h);
+		}
+		int height = nextPowerOfTwo(y + shelf);
+		if (best_area == 0 || width * height < best_area) {
+			best_area = width * height;
+			atlas_width = width;
+			atlas_height = height;
+			for (size_t i = 0; i < sprites.size(); i++) {
+				sprites[i].x = xs[i];
+				sprites[i].y = ys[i];
+			}
+		}
+		// Only gets wider from here
+		if (height <= width) {
+			break;
+		}
+	}
+}
+
+static void blit(Image& atlas, const Sprite& sprite) {
+	const Image& image = sprite.image;
+	for (int y = -PADDING; y < image.height + PADDING; y++) {
+		for (int x = -PADDING; x < image.width + PADDING; x++) {
+			int from_x = std::min(std::max(x, 0), image.width - 1);
+			int from_y = std::min(std::max(y, 0), image.height - 1);
+			const uint8_t* from = &image.pixels[((size_t)from_y * image.width + from_x) * 4];
+			uint8_t* to = &atlas.pixels[((size_t)(sprite.y + y) * atlas.width + sprite.x + x) * 4];
+			memcpy(to, from, 4);
+		}
+	}
+}
+
+static bool writeHeader(const char* path, const char* atlas_path, const std::vector<Sprite>& sprites, int width, int height) {
+	FILE* file = fopen(path, "w");
+	if (!file) {
+		return false;
+	}
+	fprintf(file, "#pragma once\n\n");
+	fprintf(file, "// Generated by AtlasPacker.cpp from:\n");
+	for (const auto& sprite : sprites) {
+		fprintf(file, "//   %s\n", sprite.path.c_str());
+	}
+	fprintf(file, "// Don't edit by hand; rerun the packer.\n\n");
+	fprintf(file, "static const char* const ATLAS_FILE = \"%s\";\n", atlas_path);
+	fprintf(file, "static const int ATLAS_WIDTH = %d;\n", width);
+	fprintf(file, "static const int ATLAS_HEIGHT = %d;\n\n", height);
+	fprintf(file, "enum AtlasSprite {\n");
+	for (const auto& sprite : sprites) {
+		fprintf(file, "\tATLAS_%s,\n", sprite.name.c_str());
+	}
+	fprintf(file, "\tATLAS_SPRITE_COUNT\n};\n\n");
+	fprintf(file, "// Pixels from the top left, and the same as UVs with v running down from\n");
+	fprintf(file, "// the top row. Flip v for a renderer that loads textures bottom row first.\n");
+	fprintf(file, "struct AtlasRect {\n\tint x, y, width, height;\n\tfloat u0, v0, u1, v1;\n};\n\n");
+	fprintf(file, "static const AtlasRect ATLAS_RECTS[ATLAS_SPRITE_COUNT] = {\n");
+	for (const auto& sprite : sprites) {
+		const Image& image = sprite.image;
+		fprintf(file, "\t{ %4d, %4d, %4d, %4d, %.6ff, %.6ff, %.6ff, %.6ff }, // %s\n",
+			sprite.x, sprite.y, image.width, image.height,
+			(float)sprite.x / width, (float)sprite.y / height,
+			(float)(sprite.x + image.width) / width, (float)(sprite.y + image.height) / height,
+			sprite.name.c_str());
+	}
+	fprintf(file, "};\n\n");
+	fprintf(file, "// The files each sprite came from, for loading them one by one instead\n");
+	fprintf(file, "static const char* const ATLAS_SOURCES[ATLAS_SPRITE_COUNT] = {\n");
+	for (const auto& sprite : sprites) {
+		fprintf(file, "\t\"%s\",\n", sprite.path.c_str());
+	}
+	fprintf(file, "};\n");
+	return fclose(file) == 0;
+}
+
+// Every rect in Atlas.h inside the atlas and clear of the others' borders,
+// its UVs the same place as its pixels, and what's there (border included)
+// the file it came from, pixel for pixel
+static int check(const char* atlas_path) {
+	Image atlas;
+	if (!loadPNG(atlas_path, atlas)) {
+		return 1;
+	}
+	int failures = 0;
+	if (atlas.width != ATLAS_WIDTH || atlas.height != ATLAS_HEIGHT) {
+		printf("%s is %dx%d, Atlas.h says %dx%d\n", atlas_path, atlas.width, atlas.height, ATLAS_WIDTH, ATLAS_HEIGHT);
+		failures++;
+	}
+	for (int i = 0; i < ATLAS_SPRITE_COUNT; i++) {
+		const AtlasRect& rect = ATLAS_RECTS[i];
+		Image source;
+		if (!loadPNG(ATLAS_SOURCES[i], source)) {
+			failures++;
+			continue;
+		}
+		bool sized = rect.width == source.width && rect.height == source.height;
+		bool inside = rect.x >= PADDING && rect.y >= PADDING &&
+			rect.x + rect.width + PADDING <= atlas.width && rect.y + rect.height + PADDING <= atlas.height;
+		bool apart = true;
+		for (int j = 0; j < ATLAS_SPRITE_COUNT; j++) {
+			const AtlasRect& other = ATLAS_RECTS[j];
+			apart = apart && (j == i ||
+				rect.x + rect.width + PADDING <= other.x - PADDING || other.x + other.width + PADDING <= rect.x - PADDING ||
+				rect.y + rect.height + PADDING <= other.y - PADDING || other.y + other.height + PADDING <= rect.y - PADDING);
+		}
+		// The header rounds them to 6 places
+		const float UV_ERROR = 1e-6f;
+		bool uvs = fabsf(rect.u0 - (float)rect.x / ATLAS_WIDTH) <= UV_ERROR &&
+			fabsf(rect.v0 - (float)rect.y / ATLAS_HEIGHT) <= UV_ERROR &&
+			fabsf(rect.u1 - (float)(rect.x + rect.width) / ATLAS_WIDTH) <= UV_ERROR &&
+			fabsf(rect.v1 - (float)(rect.y + rect.height) / ATLAS_HEIGHT) <= UV_ERROR;
+		int wrong = 0;
+		if (sized && inside) {
+			for (int y = -PADDING; y < rect.height + PADDING; y++) {
+				for (int x = -PADDING; x < rect.width + PADDING; x++) {
+					int from_x = std::min(std::max(x, 0), source.width - 1);
+					int from_y = std::min(std::max(y, 0), source.height - 1);
+					const uint8_t* from = &source.pixels[((size_t)from_y * source.width + from_x) * 4];
+					const uint8_t* at = &atlas.pixels[((size_t)(rect.y + y) * atlas.width + rect.x + x) * 4];
+					wrong += memcmp(from, at, 4) != 0;
+				}
+			}
+		}
+		bool ok = sized && inside && apart && uvs && wrong == 0;
+		printf("%-16s %4d,%4d %4dx%-4d %s%s%s%s %d pixels wrong  %s\n", ATLAS_SOURCES[i], rect.x, rect.y, rect.width, rect.height,
+			sized ? "" : " SIZE", inside ? "" : " OUTSIDE", apart ? "" : " OVERLAPS", uvs ? "" : " UVS", wrong, ok ? "ok" : "FAILED");
+		failures += !ok;
+	}
+	return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+	if (argc >= 2 && strcmp(argv[1], "check") == 0) {
+		return check(argc > 2 ? argv[2] : ATLAS_FILE);
+	}
+	if (argc < 4) {
+		fprintf(stderr, "usage: %s <atlas.png> <Atlas.h> NAME=sprite.png...\n       %s check [atlas.png]\n", argv[0], argv[0]);
+		return 1;
+	}
+	const char* atlas_path = argv[1];
+	const char* header_path = argv[2];
+
+	std::vector<Sprite> sprites;
+	for (int i = 3; i < argc; i++) {
+		const char* equals = strchr(argv[i], '=');
+		if (!equals || equals == argv[i]) {
+			fprintf(stderr, "%s: expected NAME=path\n", argv[i]);
+			return 1;
+		}
+		Sprite sprite;
+		sprite.name.assign(argv[i], equals - argv[i]);
+		sprite.path = equals + 1;
+		if (!loadPNG(sprite.path.c_str(), sprite.image)) {
+			return 1;
+		}
+		sprites.push_back(sprite);
+	}
+
+	Image atlas;
+	pack(sprites, atlas.width, atlas.height);
+	atlas.pixels.assign((size_t)atlas.width * atlas.height * 4, 0);
+	for (const auto& sprite : sprites) {
+		blit(atlas, sprite);
+	}
+
+	// The header names the atlas by file name, relative to the game's folder
+	const char* atlas_name = strrchr(atlas_path, '/');
+	atlas_name = atlas_name ? atlas_name + 1 : atlas_path;
+	if (!savePNG(atlas_path, atlas) || !writeHeader(header_path, atlas_name, sprites, atlas.width, atlas.height)) {
+		fprintf(stderr, "couldn't write %s or %s\n", atlas_path, header_path);
+		return 1;
+	}
+	printf("%d sprites into %dx%d\n", (int)sprites.size(), atlas.width, atlas.height);
+	return 0;
+}
@@ -0,0 +1,67 @@
+#include "AudioThread.h"
+
+#include <chrono>
+#include <utility>
+
+SoundRing::SoundRing(int capacity) : head(0), tail(0), pushed(0), dropped(0) {
+	uint32_t size = 1;
+	while (size < (uint32_t)capacity) {
+		size <<= 1;
+	}
+	slots.reset(new PlayCommand[size]);
+	mask = size - 1;
+}
+
+AudioThread::AudioThread(AudioBackend& backend, int ring_size)
+	: backend(backend), ring(ring_size), quitting(false), worst_tick_us(0) {
+	// How backend.start() went. Waited on asleep, since starting FMOD can
+	// take a while and the main thread has nothing else to do till then.
+	std::promise<bool> startup;
+	std::future<bool> result = startup.get_future();
+	thread = std::thread(&AudioThread::threadMain, this, std::move(startup));
+	started = result.get();
+}
+
+AudioThread::~AudioThread() {
+	quitting.store(true, std::memory_order_release);
+	thread.join();
+}
+
+void AudioThread::post(const std::vector<SoundEvent>& events) {
+	for (const auto& event : events) {
+		ring.push({ event.type, event.volume });
+	}
+}
+
+void AudioThread::threadMain(std::promise<bool> startup) {
+	bool playing = backend.start();
+	startup.set_value(playing);
+
+	PlayCommand batch[64];
+	while (true) {
+		// Read before draining, so whatever was posted before quitting still
+		// gets played
+		bool last = quitting.load(std::memory_order_acquire);
+		auto start = std::chrono::steady_clock::now();
+		int count;
+		while ((count = ring.pop(batch, 64)) > 0) {
+			if (playing) {
+				backend.play(batch, count);
+			}
+		}
+		if (playing) {
+			backend.update();
+		}
+		int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		if (us > worst_tick_us.load(std::memory_order_relaxed)) {
+			worst_tick_us.store(us, std::memory_order_relaxed);
+		}
+		if (last) {
+			break;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(AUDIO_TICK_MS));
+	}
+	if (playing) {
+		backend.stop();
+	}
+}
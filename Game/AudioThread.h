@@ -0,0 +1,134 @@
+#pragma once
+
+#include "Simulation.h"
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Sound playback on a thread of its own, so a slow FMOD call or update tick
+// can't eat into a physics or render frame. The main thread only ever writes
+// play commands into a ring; the audio thread owns the backend outright,
+// from start() to stop().
+
+struct PlayCommand {
+	SoundType type;
+	float volume;
+};
+
+// What each SoundType plays, by the name the bundle and the loose files have
+static const char* const SOUND_FILES[] = { "clack.ogg", "thump.ogg" };
+
+// Single producer, single consumer, no locks. Fixed size; a push onto a full
+// ring is dropped and counted rather than waited on.
+class SoundRing {
+	std::unique_ptr<PlayCommand[]> slots;
+	uint32_t mask;
+	// Each side only writes its own end, on a cache line of its own
+	alignas(64) std::atomic<uint32_t> head;
+	alignas(64) std::atomic<uint32_t> tail;
+	alignas(64) std::atomic<uint64_t> pushed;
+	std::atomic<uint64_t> dropped;
+
+public:
+	// Rounded up to a power of two
+	SoundRing(int capacity);
+
+	int capacity() const {
+		return (int)mask + 1;
+	}
+	// Producer only. False if it was full and the command got dropped.
+	bool push(const PlayCommand& command) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) > mask) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		slots[h & mask] = command;
+		head.store(h + 1, std::memory_order_release);
+		pushed.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+	// Consumer only. Takes up to `max` commands, oldest first.
+	int pop(PlayCommand* out, int max) {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		uint32_t available = head.load(std::memory_order_acquire) - t;
+		int count = (int)(available < (uint32_t)max ? available : (uint32_t)max);
+		for (int i = 0; i < count; i++) {
+			out[i] = slots[(t + i) & mask];
+		}
+		tail.store(t + count, std::memory_order_release);
+		return count;
+	}
+
+	// Safe from any thread, if a moment out of date
+	int depth() const {
+		return (int)(head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire));
+	}
+	uint64_t pushedCount() const {
+		return pushed.load(std::memory_order_relaxed);
+	}
+	uint64_t droppedCount() const {
+		return dropped.load(std::memory_order_relaxed);
+	}
+};
+
+// Whatever actually makes the noise. Every call comes from the audio thread.
+struct AudioBackend {
+	virtual ~AudioBackend() {}
+	// False if there's no audio; the thread then just drains the ring
+	virtual bool start() = 0;
+	// A tick's worth of commands, to be started together
+	virtual void play(const PlayCommand* commands, int count) = 0;
+	virtual void update() = 0;
+	virtual void stop() = 0;
+};
+
+// How long the audio thread sleeps between ticks. Also the most a sound can
+// start late by.
+static const int AUDIO_TICK_MS = 4;
+static const int AUDIO_RING_SIZE = 256;
+
+class AudioThread {
+	AudioBackend& backend;
+	SoundRing ring;
+	std::thread thread;
+	std::atomic<bool> quitting;
+	bool started = false;
+	// Longest single tick so far, in microseconds
+	std::atomic<int64_t> worst_tick_us;
+
+	void threadMain(std::promise<bool> startup);
+
+public:
+	// Starts the thread and waits for backend.start() to finish on it
+	AudioThread(AudioBackend& backend, int ring_size = AUDIO_RING_SIZE);
+	AudioThread(const AudioThread&) = delete;
+	AudioThread& operator=(const AudioThread&) = delete;
+	// Plays out whatever's still queued, then stops the backend
+	~AudioThread();
+
+	// What backend.start() said
+	bool isStarted() const {
+		return started;
+	}
+	// Main thread only. Never blocks; anything the ring has no room for is
+	// dropped.
+	void post(const std::vector<SoundEvent>& events);
+
+	int queueDepth() const {
+		return ring.depth();
+	}
+	uint64_t postedCount() const {
+		return ring.pushedCount();
+	}
+	uint64_t droppedCount() const {
+		return ring.droppedCount();
+	}
+	double worstTickMs() const {
+		return worst_tick_us.load(std::memory_order_relaxed) / 1000.0;
+	}
+};
@@ -0,0 +1,19 @@
+#include "BallInstances.h"
+
+void BallInstanceBuffer::build(const BallStore& balls, float alpha) {
+	int count = balls.size();
+	// resize() never gives memory back, and only grows into what's reserved
+	instances.resize(count);
+	const float* prev_x = balls.prev_x.data();
+	const float* prev_y = balls.prev_y.data();
+	const float* pos_x = balls.pos_x.data();
+	const float* pos_y = balls.pos_y.data();
+	const MatterType* matter = balls.matter.data();
+	BallInstance* out = instances.data();
+	for (int i = 0; i < count; i++) {
+		out[i].x = prev_x[i] + (pos_x[i] - prev_x[i]) * alpha;
+		out[i].y = prev_y[i] + (pos_y[i] - prev_y[i]) * alpha;
+		out[i].scale = BALL_SIZE;
+		out[i].color = (uint32_t)matter[i];
+	}
+}
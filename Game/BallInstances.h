@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Simulation.h"
+
+// Per-ball data for drawing, packed straight out of the BallStore columns.
+// It's what a SimSnapshot carries to the main thread and what the ball
+// sprites are synced from. Knows nothing about Dawn or GL, so it can be
+// filled and checked headless. Laid out for BallRenderer.cpp to draw in one
+// instanced call, which is switched off by USE_INSTANCED_BALLS in Game.cpp.
+
+struct BallInstance {
+	float x, y;
+	float scale;
+	// The matter, which indexes the colour table
+	uint32_t color;
+};
+
+static_assert(sizeof(BallInstance) == 16, "ball instance layout");
+
+class BallInstanceBuffer {
+	std::vector<BallInstance> instances;
+
+public:
+	// Refills from the balls as they are `alpha` of the way from the previous
+	// step to the latest, same as BallStore::getDrawPos(). Storage only ever
+	// grows, so once it's seen the biggest pile there's no more allocating.
+	void build(const BallStore& balls, float alpha);
+
+	const BallInstance* data() const {
+		return instances.data();
+	}
+	int count() const {
+		return (int)instances.size();
+	}
+	size_t bytes() const {
+		return instances.size() * sizeof(BallInstance);
+	}
+	size_t capacity() const {
+		return instances.capacity();
+	}
+};
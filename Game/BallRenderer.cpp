@@ -0,0 +1,141 @@
+#include "Dawn/Dawn.h"
+
+#include "BallRenderer.h"
+
+#include <cstddef>
+#include <cstdio>
+
+// Positions are in the same -1..1 space the sprites are drawn in, which is
+// straight clip space since the window is square and there's no camera
+static const char* BALL_VERTEX_SHADER = R"(
+#version 330 core
+layout(location = 0) in vec2 corner;
+layout(location = 1) in vec3 instance;
+layout(location = 2) in uint color;
+uniform vec4 colors[8];
+out vec2 local;
+out vec4 tint;
+void main() {
+	local = corner * 2.0;
+	tint = colors[color];
+	gl_Position = vec4(instance.xy + corner * instance.z, 0.0, 1.0);
+}
+)";
+
+// Grey ball lit from the top left, tinted like a sprite would be
+static const char* BALL_FRAGMENT_SHADER = R"(
+#version 330 core
+in vec2 local;
+in vec4 tint;
+out vec4 frag;
+void main() {
+	float edge = length(local);
+	float alpha = 1.0 - smoothstep(0.96, 1.0, edge);
+	if (alpha <= 0.0) {
+		discard;
+	}
+	float shade = clamp(0.95 - 0.45 * length(local - vec2(-0.35, 0.35)), 0.3, 1.0);
+	frag = vec4(tint.rgb * shade, tint.a * alpha);
+}
+)";
+
+static const int MAX_BALL_COLORS = 8;
+static_assert(MATTER_COUNT <= MAX_BALL_COLORS, "the shader only has room for MAX_BALL_COLORS tints");
+
+static unsigned int compileShader(GLenum type, const char* source) {
+	unsigned int shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, nullptr);
+	glCompileShader(shader);
+	int compiled = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+	if (!compiled) {
+		char log[1024];
+		glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+		printf("ball shader: %s\n", log);
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+BallRenderer::~BallRenderer() {
+	if (program) {
+		glDeleteProgram(program);
+		glDeleteBuffers(1, &quad_buffer);
+		glDeleteBuffers(1, &instance_buffer);
+		glDeleteVertexArrays(1, &vertex_array);
+	}
+}
+
+bool BallRenderer::create() {
+	unsigned int vertex = compileShader(GL_VERTEX_SHADER, BALL_VERTEX_SHADER);
+	unsigned int fragment = compileShader(GL_FRAGMENT_SHADER, BALL_FRAGMENT_SHADER);
+	if (!vertex || !fragment) {
+		return false;
+	}
+	program = glCreateProgram();
+	glAttachShader(program, vertex);
+	glAttachShader(program, fragment);
+	glLinkProgram(program);
+	glDeleteShader(vertex);
+	glDeleteShader(fragment);
+	int linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked) {
+		char log[1024];
+		glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+		printf("ball shader: %s\n", log);
+		glDeleteProgram(program);
+		program = 0;
+		return false;
+	}
+	colors_location = glGetUniformLocation(program, "colors");
+
+	// A unit quad as a strip, scaled per instance
+	static const float QUAD[] = {
+		-0.5f, -0.5f,
+		 0.5f, -0.5f,
+		-0.5f,  0.5f,
+		 0.5f,  0.5f,
+	};
+	glGenVertexArrays(1, &vertex_array);
+	glBindVertexArray(vertex_array);
+	glGenBuffers(1, &quad_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, quad_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(QUAD), QUAD, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+
+	glGenBuffers(1, &instance_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(BallInstance), (void*)offsetof(BallInstance, x));
+	glVertexAttribDivisor(1, 1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(BallInstance), (void*)offsetof(BallInstance, color));
+	glVertexAttribDivisor(2, 1);
+	glBindVertexArray(0);
+	return true;
+}
+
+void BallRenderer::draw(const BallInstanceBuffer& instances, const float* colors, int color_count) {
+	if (!program || instances.count() == 0) {
+		return;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	if (instances.count() > instance_capacity) {
+		// Grows like the CPU side does, so this happens a handful of times a game
+		instance_capacity = (int)instances.capacity();
+		glBufferData(GL_ARRAY_BUFFER, instance_capacity * sizeof(BallInstance), nullptr, GL_STREAM_DRAW);
+	}
+	glBufferSubData(GL_ARRAY_BUFFER, 0, instances.bytes(), instances.data());
+
+	glUseProgram(program);
+	glUniform4fv(colors_location, color_count < MAX_BALL_COLORS ? color_count : MAX_BALL_COLORS, colors);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glBindVertexArray(vertex_array);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instances.count());
+	glBindVertexArray(0);
+	glUseProgram(0);
+}
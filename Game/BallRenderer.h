@@ -0,0 +1,28 @@
+#pragma once
+
+#include "BallInstances.h"
+
+// Draws a whole BallInstanceBuffer with one instanced draw call instead of an
+// entity and sprite per ball. Needs a GL 3.3 context current, i.e. create it
+// after the window's up. The balls are shaded in the fragment shader to look
+// like Ball.png, so there's no texture to bind.
+class BallRenderer {
+	unsigned int program = 0;
+	unsigned int vertex_array = 0;
+	unsigned int quad_buffer = 0;
+	unsigned int instance_buffer = 0;
+	// How many instances the GL buffer has room for
+	int instance_capacity = 0;
+	int colors_location = -1;
+
+public:
+	BallRenderer() {}
+	BallRenderer(const BallRenderer&) = delete;
+	BallRenderer& operator=(const BallRenderer&) = delete;
+	~BallRenderer();
+
+	// False if the shaders didn't build; they get printed to stdout
+	bool create();
+	// `colors` is `color_count` RGBA tints, indexed by BallInstance::color
+	void draw(const BallInstanceBuffer& instances, const float* colors, int color_count);
+};
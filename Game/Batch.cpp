@@ -0,0 +1,79 @@
+#include "Batch.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+WorldResult runWorld(const BatchSettings& settings, uint32_t seed) {
+	Simulation sim(seed);
+	// The pool is already busy with other worlds
+	sim.setThreads(1);
+	// Same as the game plays
+	sim.explosion.mode = EXPLOSION_FIELD;
+	sim.spawn_tuning = settings.tuning;
+
+	const ClickScript& clicks = settings.clicks;
+	WorldResult result = {};
+	result.seed = seed;
+	MatterType next_ball = WHITE_MATTER;
+	for (int step = 0; step < settings.steps; step++) {
+		if (clicks.click_steps > 0 && step % clicks.click_steps == 0) {
+			SpawnCommand command;
+			command.matter = next_ball;
+			command.pos.x = clicks.min_x + (clicks.max_x - clicks.min_x) * (float)(sim.random() % 1000) / 1000;
+			command.pos.y = clicks.min_y + (clicks.max_y - clicks.min_y) * (float)(sim.random() % 1000) / 1000;
+			sim.spawn(command);
+			next_ball = sim.whichBallNext();
+			result.clicks++;
+		}
+		sim.step();
+		result.best_score = std::max(result.best_score, sim.score());
+	}
+
+	result.score = sim.score();
+	for (int i = 0; i < MATTER_COUNT; i++) {
+		result.ball_counts[i] = sim.ball_counts[i];
+	}
+	result.balls = sim.balls.size();
+	return result;
+}
+
+std::vector<WorldResult> runBatch(const BatchSettings& settings) {
+	std::vector<WorldResult> results(settings.worlds);
+	bool was_profiling = PROFILE_ENABLED();
+	PROFILE_SET_ENABLED(settings.profile && was_profiling);
+	// A world per chunk; threads that run out steal whole worlds off the others
+	WorkerPool pool(settings.threads);
+	pool.parallelFor(settings.worlds, 1, [&](int begin, int end, int) {
+		for (int w = begin; w < end; w++) {
+			results[w] = runWorld(settings, settings.first_seed + w);
+		}
+	});
+	PROFILE_SET_ENABLED(was_profiling);
+	return results;
+}
+
+Distribution distributionOf(std::vector<double>& values) {
+	Distribution distribution = {};
+	if (values.empty()) {
+		return distribution;
+	}
+	std::sort(values.begin(), values.end());
+	double sum = 0;
+	for (double value : values) {
+		sum += value;
+	}
+	distribution.mean = sum / values.size();
+	double variance = 0;
+	for (double value : values) {
+		variance += (value - distribution.mean) * (value - distribution.mean);
+	}
+	distribution.stddev = sqrt(variance / values.size());
+	size_t count = values.size();
+	distribution.min = values[0];
+	distribution.p10 = values[count / 10];
+	distribution.p50 = values[count / 2];
+	distribution.p90 = values[count * 9 / 10];
+	distribution.max = values[count - 1];
+	return distribution;
+}
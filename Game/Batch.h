@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Simulation.h"
+
+#include <cstdint>
+#include <vector>
+
+// Plays lots of games at once, one per core, for tuning the spawn balance
+// offline. Every world is its own Simulation with its own seed, and so its own
+// PRNG; nothing is shared between them, so a world comes out the same
+// whichever thread ran it and whatever else was running.
+
+// Stands in for the player: a click every `click_steps` steps, somewhere
+// random the cursor can reach, dropping whatever whichBallNext() picked after
+// the last click. The first ball is white, like in the game.
+struct ClickScript {
+	int click_steps = 30;
+	float min_x = -0.9f;
+	float max_x = 0.9f;
+	// Game::onMouseMove keeps the cursor above -0.1
+	float min_y = -0.1f;
+	float max_y = 0.9f;
+};
+
+struct BatchSettings {
+	int worlds = 256;
+	// A minute of play
+	int steps = 3600;
+	// World w gets first_seed + w
+	uint32_t first_seed = 1;
+	// 0 is one per core
+	int threads = 0;
+	ClickScript clicks;
+	SpawnTuning tuning;
+	// Record the worlds' steps into the profiler. Off by default, since every
+	// world writing into the one ring keeps it from scaling with cores.
+	bool profile = false;
+};
+
+struct WorldResult {
+	uint32_t seed;
+	int clicks;
+	// score() at the end, and the highest it got along the way
+	int score;
+	int best_score;
+	// In play at the end, by matter
+	int ball_counts[MATTER_COUNT];
+	int balls;
+};
+
+// One world, start to finish
+WorldResult runWorld(const BatchSettings& settings, uint32_t seed);
+// Every world, in seed order whatever the thread count
+std::vector<WorldResult> runBatch(const BatchSettings& settings);
+
+struct Distribution {
+	double mean;
+	double stddev;
+	double min;
+	double p10;
+	double p50;
+	double p90;
+	double max;
+};
+
+// Sorts `values`
+Distribution distributionOf(std::vector<double>& values);
@@ -0,0 +1,323 @@
+// Microbenchmarks for the pieces of a physics step, each timed on its own over
+// generated scenes of 10 to 100k balls, e.g.
+//
+//   g++ -O2 -std=c++17 -pthread Simulation.cpp WorkerPool.cpp Kernels.cpp SoundQueue.cpp Profiler.cpp FastMath.cpp StepArena.cpp Bench.cpp -o bench
+//   ./bench [max_balls] [results.json]
+//
+// "step" is all of them together, as the game runs them, from the untouched
+// scene; its allocations column should be zero, since step scratch comes out
+// of the StepArena.
+// collideBalls is the old per-ball collision, kept as a reference; collide is
+// what step() runs now, and "collide resting" is the same on a pile whose
+// contacts carry over from the step before.
+//
+// Layouts:
+//   sparse  random spots and velocities all over the arena
+//   pile    settled rows packed up from the floor, nothing annihilating
+//   chain   the same pile in alternating red and blue columns, so nearly every
+//           ball annihilates and explodes at once
+// The arena doesn't grow, so past the hundred or so balls it holds the pile
+// gets squeezed and the sparse scene stops being sparse. That's what more
+// balls actually looks like in this game.
+//
+// Every kernel gets one untimed warm-up run, then as many timed runs as fit in
+// a fraction of a second, each on a fresh copy of the scene. Allocations are
+// counted through operator new over the timed runs only, so they're the steady
+// state, not the first step. At 10 balls the clock itself is a fair chunk of
+// the number. The squeezed 100k scenes take minutes; pass a smaller max_balls
+// for a quick look.
+
+#include "Profiler.h"
+#include "Simulation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+static std::atomic<uint64_t> allocations(0);
+
+void* operator new(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* memory = malloc(size ? size : 1)) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+void operator delete(void* memory) noexcept {
+	free(memory);
+}
+void operator delete(void* memory, size_t) noexcept {
+	free(memory);
+}
+
+static const int SCENE_SIZES[] = { 10, 100, 1000, 10000, 100000 };
+
+static const int MIN_REPS = 3;
+static const int MAX_REPS = 1000;
+// Stop adding runs once this much has been timed, or one run took this long
+static const double ENOUGH_MS = 200.0;
+static const double SLOW_RUN_MS = 1000.0;
+
+enum Layout {
+	LAYOUT_SPARSE,
+	LAYOUT_PILE,
+	LAYOUT_CHAIN,
+	LAYOUT_COUNT
+};
+
+static const char* LAYOUT_NAMES[] = { "sparse", "pile", "chain" };
+
+struct Result {
+	const char* kernel;
+	Layout layout;
+	int balls;
+	int reps;
+	double ns_per_ball_step;
+	double allocations_per_step;
+};
+
+static float randomRange(Simulation& sim, float low, float high) {
+	return low + (high - low) * (float)(sim.random() % 100000) / 100000;
+}
+
+static BallStore makeScene(Layout layout, int count, Simulation& sim) {
+	BallStore balls;
+	if (layout == LAYOUT_SPARSE) {
+		for (int i = 0; i < count; i++) {
+			Vec2 pos(randomRange(sim, -0.9f, 0.9f), randomRange(sim, -0.9f, 0.9f));
+			Vec2 velocity(randomRange(sim, -1.0f, 1.0f), randomRange(sim, -1.0f, 1.0f));
+			balls.add((MatterType)(sim.random() % MATTER_COUNT), pos, velocity, 0.5);
+		}
+		return balls;
+	}
+
+	// Hex rows, just close enough for neighbours to touch, or as close as it
+	// takes to fit everything in
+	const float ROW = 0.866f;
+	float width = WALL_RIGHT - WALL_LEFT;
+	float spacing = std::min(BALL_SIZE * 0.98f, sqrtf(width * width / (count * ROW)));
+	int columns = std::max(1, (int)((width - spacing / 2) / spacing));
+	for (int i = 0; i < count; i++) {
+		int row = i / columns;
+		int column = i % columns;
+		Vec2 pos(WALL_LEFT + spacing / 2 + column * spacing + (row & 1 ? spacing / 2 : 0),
+			std::min(WALL_BOTTOM + spacing / 2 + row * spacing * ROW, WALL_TOP - spacing / 2));
+		// A pile is never quite still
+		Vec2 velocity(randomRange(sim, -0.01f, 0.01f), randomRange(sim, -0.01f, 0.01f));
+		MatterType matter;
+		if (layout == LAYOUT_CHAIN) {
+			matter = column & 1 ? BLUE_MATTER : RED_MATTER;
+		}
+		else {
+			matter = row & 1 ? RED_MATTER : WHITE_MATTER;
+		}
+		balls.add(matter, pos, velocity, 0.5);
+		balls.rest_steps[i] = SLEEP_STEPS;
+	}
+	return balls;
+}
+
+// `setup` gets a fresh copy of the scene ready, untimed; `run` is the kernel.
+// Given `live_balls`, each run is per ball in play once setup's done, rather
+// than per ball in the scene.
+static Result measure(const char* kernel, Layout layout, int count, const std::function<void()>& setup, const std::function<void()>& run,
+	const std::function<int()>& live_balls = nullptr) {
+	setup();
+	run();
+
+	int reps = 0;
+	double total_ms = 0;
+	double ball_steps = 0;
+	uint64_t allocated = 0;
+	while (reps < MAX_REPS && (reps < MIN_REPS || total_ms < ENOUGH_MS)) {
+		setup();
+		ball_steps += live_balls ? live_balls() : count;
+		uint64_t allocations_before = allocations.load(std::memory_order_relaxed);
+		auto start = std::chrono::steady_clock::now();
+		run();
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		allocated += allocations.load(std::memory_order_relaxed) - allocations_before;
+		total_ms += ms;
+		reps++;
+		if (ms > SLOW_RUN_MS) {
+			break;
+		}
+	}
+
+	Result result;
+	result.kernel = kernel;
+	result.layout = layout;
+	result.balls = count;
+	result.reps = reps;
+	result.ns_per_ball_step = ball_steps > 0 ? total_ms * 1e6 / ball_steps : 0.0;
+	result.allocations_per_step = (double)allocated / reps;
+	printf("%-16s %-7s %7d  %10.2f ns/ball-step  %8.1f allocs/step  (%d runs)\n",
+		kernel, LAYOUT_NAMES[layout], count, result.ns_per_ball_step, result.allocations_per_step, reps);
+	fflush(stdout);
+	return result;
+}
+
+static void benchScene(Layout layout, int count, std::vector<Result>& results) {
+	Simulation sim(1000 + count);
+	sim.explosion.mode = EXPLOSION_FIELD;
+	BallStore scene = makeScene(layout, count, sim);
+	BallStore work;
+	std::vector<SoundEvent> sounds;
+	std::vector<WallHit> hits;
+
+	auto fresh = [&]() {
+		work = scene;
+		sounds.clear();
+		hits.clear();
+	};
+
+	results.push_back(measure("tickGravity", layout, count, fresh, [&]() {
+		for (int i = 0; i < count; i++) {
+			work.tickGravity(i);
+		}
+	}));
+	results.push_back(measure("collideWalls", layout, count, fresh, [&]() {
+		for (int i = 0; i < count; i++) {
+			work.collideWalls(i, sounds);
+		}
+	}));
+	// What step() actually runs in place of the two above
+	results.push_back(measure("integrate+walls", layout, count, fresh, [&]() {
+		integrateAndCollideWalls(sim.kernel_level, work, 0, count, hits);
+	}));
+
+	// The old way, from both sides of every pair. Neighbour lookups included,
+	// since it paid for them per ball too.
+	// Sounds are dropped a chunk at a time; a squeezed 100k pile raises
+	// billions of clacks, more than fit in memory.
+	PointGrid grid(GRID_DIM);
+	grid.rebuild(scene.pos_x.data(), scene.pos_y.data(), count);
+	std::vector<int> neighbours;
+	std::vector<Modification> modifications(count);
+	results.push_back(measure("collideBalls", layout, count, fresh, [&]() {
+		for (int i = 0; i < count; i++) {
+			if (i % PHYSICS_CHUNK == 0) {
+				sounds.clear();
+			}
+			grid.neighbours(grid.point_cells[i], neighbours);
+			modifications[i] = work.collideBalls(i, neighbours, sounds);
+		}
+	}));
+
+	// What step() runs instead: each pair found once, from the grid
+	auto fresh_sim = [&]() {
+		sim.beginStep();
+		sim.balls = scene;
+		sim.sounds.clear();
+		sim.explosions.clear();
+		sim.broadphase();
+	};
+	results.push_back(measure("collide", layout, count, fresh_sim, [&]() {
+		sim.collide();
+	}));
+	// The pile again once it's been resting a while, so the contacts the last
+	// run found are carried over rather than searched for
+	if (layout != LAYOUT_SPARSE) {
+		BallStore settled = scene;
+		for (int i = 0; i < count; i++) {
+			settled.rest_steps[i] = SLEEP_STEPS + 1;
+		}
+		results.push_back(measure("collide resting", layout, count, [&]() {
+			sim.beginStep();
+			sim.balls = settled;
+			sim.sounds.clear();
+			sim.broadphase();
+		}, [&]() {
+			sim.collide();
+		}));
+	}
+
+	// Whatever collided into the opposite matter goes up
+	BallStore untouched = scene;
+	for (int i = 0; i < count; i++) {
+		if (modifications[i].annihilating) {
+			scene.flags[i] |= BALL_ANNIHILATING;
+		}
+	}
+	results.push_back(measure("annihilate", layout, count, fresh_sim, [&]() {
+		sim.annihilate();
+	}));
+	std::vector<Vec2> explosions = sim.explosions;
+
+	results.push_back(measure("cleanSlop", layout, count, fresh, [&]() {
+		for (int i = 0; i < count; i++) {
+			work.cleanSlop(i);
+		}
+	}));
+	// Against the whole scene, as if the explosions had come from elsewhere
+	results.push_back(measure("explosions", layout, count, [&]() {
+		sim.beginStep();
+		sim.balls = scene;
+		sim.explosions = explosions;
+	}, [&]() {
+		sim.applyExplosions();
+	}));
+
+	// The whole thing, on a Simulation of its own so nothing the rows above
+	// left behind (resting pairs, counts, flags) carries in. The warm-up run
+	// grows its scratch and setup folds that into one block, so the timed
+	// steps should allocate nothing.
+	Simulation stepper(1000 + count);
+	stepper.explosion.mode = EXPLOSION_FIELD;
+	results.push_back(measure("step", layout, count, [&]() {
+		stepper.reset(untouched);
+		stepper.beginStep();
+	}, [&]() {
+		stepper.step();
+	}, [&]() {
+		return stepper.balls.size();
+	}));
+}
+
+static bool writeJson(const char* path, const std::vector<Result>& results) {
+	FILE* file = fopen(path, "w");
+	if (!file) {
+		return false;
+	}
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"kernel_level\": \"%s\",\n", kernelLevelName(detectKernelLevel()));
+	fprintf(file, "\t\"results\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const auto& result = results[i];
+		fprintf(file, "\t\t{ \"kernel\": \"%s\", \"layout\": \"%s\", \"balls\": %d, \"runs\": %d, \"ns_per_ball_step\": %.3f, \"allocations_per_step\": %.2f }%s\n",
+			result.kernel, LAYOUT_NAMES[result.layout], result.balls, result.reps,
+			result.ns_per_ball_step, result.allocations_per_step, i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+	return fclose(file) == 0;
+}
+
+int main(int argc, char** argv) {
+	int max_balls = argc > 1 ? atoi(argv[1]) : 100000;
+	const char* json_path = argc > 2 ? argv[2] : "bench.json";
+
+	printf("kernel: %s\n", kernelLevelName(detectKernelLevel()));
+	std::vector<Result> results;
+	for (int layout = 0; layout < LAYOUT_COUNT; layout++) {
+		for (int count : SCENE_SIZES) {
+			if (count <= max_balls) {
+				benchScene((Layout)layout, count, results);
+			}
+		}
+	}
+
+	if (!writeJson(json_path, results)) {
+		printf("couldn't write %s\n", json_path);
+		return 1;
+	}
+	printf("wrote %s\n", json_path);
+	return 0;
+}
@@ -0,0 +1,154 @@
+#include "Bundle.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+Bundle::~Bundle() {
+	close();
+}
+
+bool Bundle::open(const char* path) {
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER file_size;
+	HANDLE mapping = nullptr;
+	if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	}
+	const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!view) {
+		if (mapping) {
+			CloseHandle(mapping);
+		}
+		CloseHandle(file);
+		return false;
+	}
+	file_handle = file;
+	mapping_handle = mapping;
+	mapped = (const uint8_t*)view;
+	mapped_size = (size_t)file_size.QuadPart;
+#else
+	int file = ::open(path, O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+	struct stat info;
+	void* view = MAP_FAILED;
+	if (fstat(file, &info) == 0 && info.st_size > 0) {
+		view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	}
+	// The mapping keeps the file alive on its own
+	::close(file);
+	if (view == MAP_FAILED) {
+		return false;
+	}
+	mapped = (const uint8_t*)view;
+	mapped_size = (size_t)info.st_size;
+#endif
+
+	// Check the index makes sense before trusting any of it
+	const BundleHeader* header = (const BundleHeader*)mapped;
+	bool valid = mapped_size >= sizeof(BundleHeader) &&
+		memcmp(header->magic, BUNDLE_MAGIC, 4) == 0 &&
+		header->version == BUNDLE_VERSION &&
+		header->count <= (mapped_size - sizeof(BundleHeader)) / sizeof(BundleEntry);
+	if (valid) {
+		entries = (const BundleEntry*)(mapped + sizeof(BundleHeader));
+		count = header->count;
+		for (uint32_t i = 0; i < count && valid; i++) {
+			const auto& entry = entries[i];
+			valid = memchr(entry.name, 0, BUNDLE_NAME_SIZE) != nullptr &&
+				entry.offset <= mapped_size && entry.size <= mapped_size - entry.offset;
+		}
+	}
+	if (!valid) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void Bundle::close() {
+	if (mapped) {
+#ifdef _WIN32
+		UnmapViewOfFile(mapped);
+		CloseHandle((HANDLE)mapping_handle);
+		CloseHandle((HANDLE)file_handle);
+		mapping_handle = nullptr;
+		file_handle = nullptr;
+#else
+		munmap((void*)mapped, mapped_size);
+#endif
+	}
+	mapped = nullptr;
+	mapped_size = 0;
+	entries = nullptr;
+	count = 0;
+}
+
+const BundleEntry* Bundle::find(const char* name) const {
+	// Entries are sorted by name
+	uint32_t low = 0;
+	uint32_t high = count;
+	while (low < high) {
+		uint32_t middle = (low + high) / 2;
+		int order = strncmp(entries[middle].name, name, BUNDLE_NAME_SIZE);
+		if (order == 0) {
+			return &entries[middle];
+		}
+		if (order < 0) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return nullptr;
+}
+
+bool writeBundle(const char* path, const std::vector<BundleAsset>& assets) {
+	BundleHeader header = {};
+	memcpy(header.magic, BUNDLE_MAGIC, 4);
+	header.version = BUNDLE_VERSION;
+	header.count = (uint32_t)assets.size();
+
+	std::vector<BundleEntry> entries(assets.size());
+	uint64_t offset = sizeof(BundleHeader) + entries.size() * sizeof(BundleEntry);
+	for (size_t i = 0; i < assets.size(); i++) {
+		offset = (offset + BUNDLE_ALIGNMENT - 1) / BUNDLE_ALIGNMENT * BUNDLE_ALIGNMENT;
+		memset(entries[i].name, 0, BUNDLE_NAME_SIZE);
+		memcpy(entries[i].name, assets[i].name.c_str(), assets[i].name.size());
+		entries[i].offset = offset;
+		entries[i].size = assets[i].contents.size();
+		offset += assets[i].contents.size();
+	}
+
+	std::vector<uint8_t> bundle(offset, 0);
+	memcpy(bundle.data(), &header, sizeof(header));
+	memcpy(bundle.data() + sizeof(header), entries.data(), entries.size() * sizeof(BundleEntry));
+	for (size_t i = 0; i < assets.size(); i++) {
+		memcpy(bundle.data() + entries[i].offset, assets[i].contents.data(), assets[i].contents.size());
+	}
+
+	FILE* file = fopen(path, "wb");
+	if (!file) {
+		return false;
+	}
+	bool ok = fwrite(bundle.data(), 1, bundle.size(), file) == bundle.size();
+	return fclose(file) == 0 && ok;
+}
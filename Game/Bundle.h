@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One file holding all the assets, mapped into memory whole. The index is read
+// straight out of the mapping, so nothing is copied or parsed at startup; an
+// asset is just a pointer and a size into it. Built by BundleBuilder.cpp, or
+// anything else that calls writeBundle().
+//
+// Layout: a BundleHeader, `count` BundleEntry records sorted by name, then
+// the file contents, each starting on a BUNDLE_ALIGNMENT boundary. Stored as
+// the structs themselves, so little-endian only, like everything we ship on.
+
+static const char BUNDLE_MAGIC[4] = { 'N', 'C', 'B', 'N' };
+static const uint32_t BUNDLE_VERSION = 1;
+static const int BUNDLE_ALIGNMENT = 16;
+static const int BUNDLE_NAME_SIZE = 48;
+
+struct BundleHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t count;
+	uint32_t reserved;
+};
+
+struct BundleEntry {
+	// Relative path with forward slashes, e.g. "numbers/0.png"
+	char name[BUNDLE_NAME_SIZE];
+	uint64_t offset;
+	uint64_t size;
+};
+
+static_assert(sizeof(BundleHeader) == 16, "bundle header layout");
+static_assert(sizeof(BundleEntry) == 64, "bundle entry layout");
+
+struct BundleAsset {
+	// What the game asks for it by, see BundleEntry::name
+	std::string name;
+	std::vector<uint8_t> contents;
+};
+
+// Lays `assets` out as above and writes them to `path`. They have to be sorted
+// by name already, with no name twice. False if it couldn't be written.
+bool writeBundle(const char* path, const std::vector<BundleAsset>& assets);
+
+class Bundle {
+	const uint8_t* mapped = nullptr;
+	size_t mapped_size = 0;
+	const BundleEntry* entries = nullptr;
+	uint32_t count = 0;
+#ifdef _WIN32
+	void* file_handle = nullptr;
+	void* mapping_handle = nullptr;
+#endif
+
+public:
+	Bundle() {}
+	Bundle(const Bundle&) = delete;
+	Bundle& operator=(const Bundle&) = delete;
+	~Bundle();
+
+	// False if it's missing or not a bundle; everything else then returns
+	// nothing and callers go back to loose files
+	bool open(const char* path);
+	void close();
+	bool isOpen() const {
+		return mapped != nullptr;
+	}
+
+	// nullptr if there's no such asset
+	const BundleEntry* find(const char* name) const;
+	const uint8_t* data(const BundleEntry& entry) const {
+		return mapped + entry.offset;
+	}
+
+	uint32_t size() const {
+		return count;
+	}
+	const BundleEntry& entry(uint32_t i) const {
+		return entries[i];
+	}
+};
@@ -0,0 +1,102 @@
+// Packs the game's assets into one bundle file (see Bundle.h), e.g. from the
+// Game folder:
+//
+//   g++ -O2 -std=c++17 BundleBuilder.cpp Bundle.cpp -o bundle_builder
+//   ./bundle_builder assets.bundle Ball.png numbers clack.ogg thump.ogg
+//
+// Folders are walked for .png and .ogg files. Assets are named by the path
+// given, with forward slashes, which is what the game asks the bundle for.
+
+#include "Bundle.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+static bool readFile(const std::string& path, std::vector<uint8_t>& data) {
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file) {
+		return false;
+	}
+	uint8_t buffer[4096];
+	size_t got;
+	while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		data.insert(data.end(), buffer, buffer + got);
+	}
+	fclose(file);
+	return true;
+}
+
+static bool addFile(const std::string& path, std::vector<BundleAsset>& assets) {
+	BundleAsset asset;
+	asset.name = path;
+	std::replace(asset.name.begin(), asset.name.end(), '\\', '/');
+	if (asset.name.compare(0, 2, "./") == 0) {
+		asset.name.erase(0, 2);
+	}
+	if (asset.name.size() >= BUNDLE_NAME_SIZE) {
+		fprintf(stderr, "%s: name longer than %d characters\n", path.c_str(), BUNDLE_NAME_SIZE - 1);
+		return false;
+	}
+	if (!readFile(path, asset.contents)) {
+		fprintf(stderr, "%s: couldn't read\n", path.c_str());
+		return false;
+	}
+	assets.push_back(asset);
+	return true;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s <out.bundle> <file or folder>...\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<BundleAsset> assets;
+	for (int i = 2; i < argc; i++) {
+		std::filesystem::path path(argv[i]);
+		if (!std::filesystem::is_directory(path)) {
+			if (!addFile(argv[i], assets)) {
+				return 1;
+			}
+			continue;
+		}
+		std::vector<std::string> found;
+		for (const auto& item : std::filesystem::recursive_directory_iterator(path)) {
+			auto extension = item.path().extension().string();
+			if (item.is_regular_file() && (extension == ".png" || extension == ".ogg")) {
+				found.push_back(item.path().generic_string());
+			}
+		}
+		// Directory order isn't stable between machines
+		std::sort(found.begin(), found.end());
+		for (const auto& file : found) {
+			if (!addFile(file, assets)) {
+				return 1;
+			}
+		}
+	}
+
+	std::sort(assets.begin(), assets.end(), [](const BundleAsset& a, const BundleAsset& b) {
+		return strcmp(a.name.c_str(), b.name.c_str()) < 0;
+	});
+	for (size_t i = 1; i < assets.size(); i++) {
+		if (assets[i].name == assets[i - 1].name) {
+			fprintf(stderr, "%s: listed twice\n", assets[i].name.c_str());
+			return 1;
+		}
+	}
+
+	if (!writeBundle(argv[1], assets)) {
+		fprintf(stderr, "%s: couldn't write\n", argv[1]);
+		return 1;
+	}
+	for (const auto& asset : assets) {
+		printf("%8llu  %s\n", (unsigned long long)asset.contents.size(), asset.name.c_str());
+	}
+	printf("%d assets, %llu bytes\n", (int)assets.size(), (unsigned long long)std::filesystem::file_size(argv[1]));
+	return 0;
+}
@@ -0,0 +1,20 @@
+#include "FastMath.h"
+
+void fastRsqrtBatch(const float* in, float* out, int count) {
+	int i = 0;
+#if FAST_MATH_SSE
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 smallest = _mm_set1_ps(FLT_MIN);
+	const __m128 largest = _mm_set1_ps(FLT_MAX);
+	for (; i + 4 <= count; i += 4) {
+		__m128 x = _mm_loadu_ps(in + i);
+		// Both exactly rounded, like fastRsqrt(), so the two agree exactly
+		__m128 y = _mm_div_ps(one, _mm_sqrt_ps(x));
+		__m128 normal = _mm_and_ps(_mm_cmpge_ps(x, smallest), _mm_cmple_ps(x, largest));
+		_mm_storeu_ps(out + i, _mm_and_ps(y, normal));
+	}
+#endif
+	for (; i < count; i++) {
+		out[i] = fastRsqrt(in[i]);
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cfloat>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define FAST_MATH_SSE 1
+#include <immintrin.h>
+#else
+#define FAST_MATH_SSE 0
+#endif
+
+// 1/sqrt, sqrt and a cheaper acos for the per-pair and per-explosion sums.
+// None of them ever return NaN. `headless check` measures them against libm
+// and fails if they're further off than the bounds below.
+
+// Relative error of fastRsqrt() and fastSqrt(), about two roundings' worth
+static const float FAST_RSQRT_ERROR = 2.5e-7f;
+// Absolute error of fastAcos(), in radians
+static const float FAST_ACOS_ERROR = 1e-6f;
+
+// 0 for anything that isn't a normal positive float (zero, denormals,
+// infinity, NaN), so a zero length comes out as a zero vector instead of a
+// NaN. Not rsqrtss: its estimate differs between Intel and AMD, and this
+// feeds the contact normals, so the checksums and replays would only match
+// on one of them. sqrt and divide are rounded exactly everywhere.
+inline float fastRsqrt(float x) {
+	if (!(x >= FLT_MIN && x <= FLT_MAX)) {
+		return 0;
+	}
+	return 1.0f / sqrtf(x);
+}
+
+// 0 for anything below the smallest normal float, NaN included
+inline float fastSqrt(float x) {
+	if (!(x >= FLT_MIN)) {
+		return 0;
+	}
+	if (x > FLT_MAX) {
+		return x;
+	}
+	return x * fastRsqrt(x);
+}
+
+// Abramowitz & Stegun 4.4.46. Anything outside [-1, 1], NaN included, is
+// clamped into it first, so a dot product of two unit vectors that rounded
+// to just over 1 is fine.
+inline float fastAcos(float x) {
+	x = x > 1 ? 1 : (x > -1 ? x : -1);
+	float a = fabsf(x);
+	float r = fastSqrt(1 - a) * (1.5707963050f + a * (-0.2145988016f + a * (0.0889789874f + a * (-0.0501743046f
+		+ a * (0.0308918810f + a * (-0.0170881256f + a * (0.0066700901f - 0.0012624911f * a)))))));
+	return x < 0 ? 3.14159265f - r : r;
+}
+
+// out[i] = fastRsqrt(in[i]), four at a time. `in` and `out` may be the same.
+void fastRsqrtBatch(const float* in, float* out, int count);
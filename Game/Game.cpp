@@ -1,383 +1,239 @@
 #include "Dawn/Dawn.h"
 
+#include "Atlas.h"
+#include "AudioThread.h"
+#include "BallInstances.h"
+#include "BallRenderer.h"
+#include "Bundle.h"
+#include "Governor.h"
+#include "Pipeline.h"
+#include "Recording.h"
+#include "Profiler.h"
+#include "Simulation.h"
+#include "SoundQueue.h"
+
 #include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <cmath>
 #include <functional>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <thread>
 #include <vector>
 
 #include <fmod.hpp>
 
-static const float PI = 3.1415927;
-
-static const float PHYSICS_TIMESTEP = 1.0f / 60.0f;
-static const float BALL_SIZE = 0.2f;
-
-static float SqrMagnitude(Dawn::Vec3 vec) {
-    return vec.x * vec.x + vec.y * vec.y + vec.z * vec.z;
-}
-
-static float Magnitude(Dawn::Vec3 vec) {
-    return sqrt(vec.x * vec.x + vec.y * vec.y + vec.z * vec.z);
-}
-
-static Dawn::Vec3 Norm(Dawn::Vec3 vec) {
-	if (vec.x == 0 && vec.y == 0 && vec.z == 0) {
-		return Dawn::Vec3(0, 0, 0);
+// The game's sounds, mapped in once. Has to outlive them, since they may play
+// straight out of it.
+static Bundle assets;
+
+// FMOD, driven entirely from the audio thread (see AudioThread.h). Sounds load
+// out of the bundle if it has them, otherwise off disk. Textures are always
+// loose files, since Dawn can't load one from memory (see dawn-issues.txt).
+struct FmodBackend : AudioBackend {
+	FMOD::System* system = nullptr;
+	FMOD::Sound* clack_sound = nullptr;
+	FMOD::Sound* thump_sound = nullptr;
+
+	FMOD::Sound* loadSound(const char* name) {
+		FMOD::Sound* sound = nullptr;
+		if (const BundleEntry* entry = assets.find(name)) {
+			const char* data = (const char*)assets.data(*entry);
+			FMOD_CREATESOUNDEXINFO info = {};
+			info.cbsize = sizeof(info);
+			info.length = (unsigned int)entry->size;
+			// POINT plays the mapped bytes in place rather than copying them.
+			// Not checked against FMOD that it takes a raw .ogg this way, so
+			// if it won't, it gets a copy like a loose file would.
+			if (system->createSound(data, FMOD_OPENMEMORY_POINT | FMOD_CREATECOMPRESSEDSAMPLE, &info, &sound) == FMOD_OK) {
+				return sound;
+			}
+			sound = nullptr;
+			system->createSound(data, FMOD_OPENMEMORY, &info, &sound);
+			return sound;
+		}
+		system->createSound(name, FMOD_DEFAULT, nullptr, &sound);
+		return sound;
 	}
-	return vec / Magnitude(vec);
-}
-
-static const Dawn::Vec3 ACCEL_GRAVITY(0, -1.5, 0);
-static const float SLOP_MAXIMUM = 0.05;
-
-static FMOD::System* fmod_system = nullptr;
-static FMOD::Sound* clack_sound;
-static FMOD::Sound* thump_sound;
-
-static void playSound(FMOD::Sound* sound, float volume) {
-	FMOD::Channel* channel;
-	fmod_system->playSound(sound, nullptr, true, &channel);
-	channel->setVolume(volume);
-	channel->setPaused(false);
-}
-
-enum MatterType {
-	WHITE_MATTER,
-	RED_MATTER,
-	BLUE_MATTER
-};
-
-struct Ball {
-	MatterType matter;
-	Dawn::Scene* scene;
-	Dawn::Entity entity;
-	//Dawn::TransformComponent& transform;
-	float time_passed = 0;
-
-	float mass;
-	Dawn::Vec3 velocity;
-	bool annihilating = false;
-	Dawn::Vec3 explosion_impulse;
-
-	Ball(Dawn::Scene* scene, MatterType matter, Dawn::Entity ent, float mass)
-		: scene(scene), matter(matter), entity(ent), velocity(0, 0, 0), mass(mass), explosion_impulse(0, 0, 0) {
-		//transform = scene.getComponent<Dawn::TransformComponent>(ent);
+	bool start() override {
+		if (FMOD::System_Create(&system) != FMOD_OK) {
+			return false;
+		}
+		// stop() only runs after a successful start
+		if (system->init(512, FMOD_INIT_NORMAL, nullptr) != FMOD_OK) {
+			system->release();
+			system = nullptr;
+			return false;
+		}
+		clack_sound = loadSound(SOUND_FILES[SOUND_CLACK]);
+		thump_sound = loadSound(SOUND_FILES[SOUND_THUMP]);
+		return true;
 	}
-	/*
-	Ball(const Ball& ball) : scene(ball.scene) {
-		matter = ball.matter;
-		entity = ball.entity;
-		time_passed = ball.time_passed;
-		mass = ball.mass;
-		velocity = ball.velocity;
-		annihilating = ball.annihilating;
+	// Starts every sound paused, then lets them all go together
+	void play(const PlayCommand* commands, int count) override {
+		FMOD::Channel* channels[64];
+		for (int begin = 0; begin < count; begin += 64) {
+			int batch = std::min(count - begin, 64);
+			for (int i = 0; i < batch; i++) {
+				const auto& command = commands[begin + i];
+				FMOD::Sound* sound = command.type == SOUND_CLACK ? clack_sound : thump_sound;
+				channels[i] = nullptr;
+				system->playSound(sound, nullptr, true, &channels[i]);
+				if (channels[i]) {
+					channels[i]->setVolume(command.volume);
+				}
+			}
+			for (int i = 0; i < batch; i++) {
+				if (channels[i]) {
+					channels[i]->setPaused(false);
+				}
+			}
+		}
 	}
-	~Ball() {
-		scene.deleteEntity(entity);
-	}*/
-    Dawn::Vec3 getPos() {
-        auto& transform = scene->getComponent<Dawn::TransformComponent>(entity);
-        return transform.position;
-    }
-	float kineticEnergy() {
-		return 0.5 * mass * SqrMagnitude(velocity);
+	void update() override {
+		system->update();
 	}
-	float potentialEnergy() {
-		return Magnitude(ACCEL_GRAVITY) * mass * (getPos().y + 1.0);
+	void stop() override {
+		system->release();
+		system = nullptr;
 	}
-	void tickGravity() {
-		auto& transform = scene->getComponent<Dawn::TransformComponent>(entity);
-		Dawn::Vec3& pos = transform.position;
-		
-		float d_time = PHYSICS_TIMESTEP;
-
-		time_passed += d_time;
-		float wind;
-		{
-			float freq = 0.2;
-			float amplitude = 0.5;
-			wind = amplitude * sin(PI * freq * time_passed);
-		}
-		//std::cout << wind << std::endl;
-
-		// Do explosion impulses here out of sheer laziness
-		auto acceleration = ACCEL_GRAVITY + explosion_impulse;
-		explosion_impulse = Dawn::Vec3(0, 0, 0);
-
-		Dawn::Vec3 d_velocity =
-			(acceleration * d_time);
-
-		Dawn::Vec3 d_position =
-			(velocity * d_time) + (acceleration * 0.5 * d_time * d_time);
+};
 
-		velocity = velocity + d_velocity;
-		pos = pos + d_position;
+// One per matter type, from MATTER_INFO
+static std::vector<Dawn::Vec4> ballColors() {
+	std::vector<Dawn::Vec4> colors;
+	for (const MatterInfo& info : MATTER_INFO) {
+		colors.push_back(Dawn::Vec4(info.color[0], info.color[1], info.color[2], info.color[3]));
 	}
-	void collideWalls() {
-		const float BOTTOM = -1.0f;
-		const float LEFT   = -1.0f;
-		const float RIGHT  = +1.0f;
-
-		auto& transform = scene->getComponent<Dawn::TransformComponent>(entity);
-		Dawn::Vec3& pos = transform.position;
-
-        const float ELASTICITY = 0.9;
-
-		// Bottom wall
-		if ((pos.y - (BALL_SIZE / 2)) <= BOTTOM) {
-			// Displacement
-			float y_displace = BOTTOM - (pos.y - (BALL_SIZE / 2));
-			Dawn::Vec3 n_displace = Norm(velocity) * -1;
-			Dawn::Vec3 displace(n_displace.x / n_displace.y * y_displace, y_displace, 0);
-			// Inelastic collision
-			Dawn::Vec3 bounce_velocity(velocity.x * ELASTICITY, -velocity.y * ELASTICITY, 0);
-
-			// Update
-			pos = pos + displace;
-			velocity = bounce_velocity;
-
-			if (Magnitude(velocity) > 0.5) {
-				playSound(thump_sound, fmin(fmax(0.0, Magnitude(velocity) - 0.5), 1.0));
-			}
-		}
-
-		// Top wall
-		if ((pos.y + (BALL_SIZE / 2)) >= 1.0f) {
-			// Displacement
-			float y_displace = 1.0f - (pos.y + (BALL_SIZE / 2));
-			Dawn::Vec3 n_displace = Norm(velocity) * -1;
-			Dawn::Vec3 displace(n_displace.x / n_displace.y * y_displace, y_displace, 0);
-			// Inelastic collision
-			Dawn::Vec3 bounce_velocity(velocity.x * ELASTICITY, -velocity.y * ELASTICITY, 0);
+	return colors;
+}
+static const std::vector<Dawn::Vec4> BALL_COLORS = ballColors();
 
-			// Update
-			pos = pos + displace;
-			velocity = bounce_velocity;
+static const float CURSOR_ALPHA = 0.3;
 
-			if (Magnitude(velocity) > 0.5) {
-				playSound(thump_sound, fmin(fmax(0.0, Magnitude(velocity) - 0.5), 1.0));
-			}
-		}
+// Every texture the sprites use, each loaded once and shared. The sprites
+// are the ones AtlasPacker.cpp packed into atlas.png, so once Dawn sprites
+// can show part of a texture (see dawn-issues.txt) apply() points them all at
+// the atlas with ATLAS_RECTS[which] instead, and load() decodes just that.
+struct SpriteSheet {
+	Dawn::Texture textures[ATLAS_SPRITE_COUNT];
 
-		// Side walls
-		if ((pos.x - (BALL_SIZE / 2)) <= LEFT ||
-			(pos.x + (BALL_SIZE / 2)) >= RIGHT) {
-			// Displacement
-			float x_displace = ((pos.x - (BALL_SIZE / 2)) <= LEFT)
-				? (LEFT - (pos.x - (BALL_SIZE / 2)))
-				: (RIGHT - (pos.x + (BALL_SIZE / 2)));
-			Dawn::Vec3 n_displace = Norm(velocity) * -1;
-			Dawn::Vec3 displace(x_displace, n_displace.y / n_displace.x * x_displace, 0);
-			// Inelastic collision
-			Dawn::Vec3 bounce_velocity(-velocity.x * ELASTICITY, velocity.y * ELASTICITY, 0);
-
-			// Update
-			pos = pos + displace;
-			velocity = bounce_velocity;
-
-			if (Magnitude(velocity) > 0.5) {
-				playSound(thump_sound, fmin(fmax(0.0, Magnitude(velocity) - 0.5), 1.0));
-			}
+	void load() {
+		for (int i = 0; i < ATLAS_SPRITE_COUNT; i++) {
+			textures[i].loadFromFile(ATLAS_SOURCES[i]);
 		}
 	}
-	std::tuple<Dawn::Vec3, float> collideBalls(int id, const std::vector<Ball>& balls) {
-		auto& transform = scene->getComponent<Dawn::TransformComponent>(entity);
-		Dawn::Vec3& pos = transform.position;
-
-		Dawn::Vec3 total_acceleration(0, 0, 0);
-		float total_energy_loss = 1.0;
-		for (int i = 0; i < balls.size(); i++) {
-			if (i == id) {
-				continue;
-			}
-			auto& ball = balls[i];
-			auto& ball_transform = scene->getComponent<Dawn::TransformComponent>(ball.entity);
-			auto& ball_pos = ball_transform.position;
-
-			float d_x = pos.x - ball_pos.x;
-			float d_y = pos.y - ball_pos.y;
-			float distance_squared = d_x * d_x + d_y * d_y;
-			if (distance_squared > BALL_SIZE * BALL_SIZE) {
-				continue;
-			}
-
-			// Do we annihilate?
-			if ((matter == RED_MATTER  && ball.matter == BLUE_MATTER) ||
-				(matter == BLUE_MATTER && ball.matter == RED_MATTER)) {
-				annihilating = true;
-			}
+	void apply(Dawn::SpriteRendererComponent& sprite, AtlasSprite which) {
+		sprite.texture = &textures[which];
+	}
+};
 
-			// Overlap detected - add force
-			if (Magnitude(velocity) > 0.5) {
-				playSound(clack_sound, fmin(fmax(0.0, Magnitude(velocity) - 0.5), 1.0));
-			}
-			float force_constant = 0.5;
-			if (distance_squared == 0) {
-				distance_squared = 0.01;
-			}
-			float accel_magnitude = force_constant / (distance_squared * mass);
-			Dawn::Vec3 force_normal = Norm(Dawn::Vec3(d_x, d_y, 0));
-			if (force_normal.x == 0 && force_normal.y == 0) {
-				force_normal = Dawn::Vec3(-1.0, 0, 0);
-			}
-			total_acceleration = total_acceleration + (force_normal * accel_magnitude);
-
-			// Energy loss
-			auto vel_normal = Normalize(velocity);
-			auto ball_vel_normal = Norm(ball.velocity);
-			float dot = Dawn::Dot(vel_normal, ball_vel_normal);
-			float energy_loss = sqrt((PI - acos(dot)) / PI);
-			if (isnan(energy_loss)) {
-				continue;
-			}
-			total_energy_loss *= energy_loss;
+// Draw the balls as one instanced batch straight out of the snapshot (see
+// BallRenderer.cpp) instead of an entity and sprite each. Off until Dawn lets
+// a custom draw in at a known point in the scene's draw order (see
+// dawn-issues.txt); until then nothing says it lands after the background.
+#define USE_INSTANCED_BALLS 0
+
+// Step physics on a thread of its own while the main thread draws the frame
+// before (see Pipeline.h). 0 runs them one after the other, the same way.
+#define PIPELINED_PHYSICS 1
+
+// Prints per-phase p50/p99 to the console every this many frames; 0 is off
+static const int PROFILE_SUMMARY_FRAMES = 0;
+
+// Keeps a line on the console up to date with how many balls are awake and
+// asleep, for watching sleep kick in
+static const bool PRINT_SLEEP_COUNTS = false;
+
+// A right-aligned number drawn with a fixed set of digit sprites that are made
+// once. Changing the value only swaps textures and hides unused digits.
+struct DigitCounter {
+	// Enough for any int
+	static const int MAX_DIGITS = 10;
+	Dawn::Entity digits[MAX_DIGITS];
+
+	void create(Dawn::Scene& scene, SpriteSheet& sprites, Dawn::Vec3 base_position) {
+		for (int i = 0; i < MAX_DIGITS; i++) {
+			digits[i] = scene.addEntity();
+
+			scene.addComponent<Dawn::TransformComponent>(digits[i]);
+			auto& transform = scene.getComponent<Dawn::TransformComponent>(digits[i]);
+			transform.position = Dawn::Vec3(base_position.x - i * 0.08, base_position.y, 0);
+			transform.scale = Dawn::Vec3(0.1, 0.1, 1.0);
+
+			scene.addComponent<Dawn::SpriteRendererComponent>(digits[i]);
+			auto& sprite = scene.getComponent<Dawn::SpriteRendererComponent>(digits[i]);
+			sprites.apply(sprite, ATLAS_DIGIT_0);
+			sprite.color = Dawn::Vec4(1.0, 1.0, 1.0, 0.0);
 		}
-
-		return std::make_tuple(total_acceleration, total_energy_loss);
 	}
-	void cleanSlop() {
-		if ((kineticEnergy() + potentialEnergy()) < SLOP_MAXIMUM) {
-			// Oppose slop with a small force
-			float amt = 0.9;
-			Dawn::Vec3 slop_fighter = velocity * -1.0f * amt / PHYSICS_TIMESTEP;
-			velocity = slop_fighter * PHYSICS_TIMESTEP + velocity;
+	void set(Dawn::Scene& scene, SpriteSheet& sprites, int value) {
+		unsigned int remaining = value > 0 ? value : 0;
+		for (int i = 0; i < MAX_DIGITS; i++) {
+			auto& sprite = scene.getComponent<Dawn::SpriteRendererComponent>(digits[i]);
+			// Always show the ones digit, so zero still reads as "0"
+			bool visible = i == 0 || remaining > 0;
+			sprites.apply(sprite, (AtlasSprite)(ATLAS_DIGIT_0 + remaining % 10));
+			sprite.color.w = visible ? 1.0 : 0.0;
+			remaining /= 10;
 		}
 	}
 };
 
-static const Dawn::Vec4 BALL_COLORS[] = {
-		Dawn::Vec4(1.0, 1.0, 1.0, 1.0),
-		Dawn::Vec4(1.0, 0.0, 0.0, 1.0),
-		Dawn::Vec4(0.0, 0.0, 1.0, 1.0)
-};
-static const float BALL_CHANCES[] = {
-	0.25, 0.37, 0.38
-};
-static const size_t BALL_COLOR_COUNT = sizeof(BALL_COLORS) / sizeof(Dawn::Vec4);
-
-static const float CURSOR_ALPHA = 0.3;
-static const int BASE_CHANCE_POINTS[]   = {   20,   40,   40 };
-static const int EXPECTED_PROPORTIONS[] = { 0.20, 0.40, 0.40 };
-
 class Game : public Dawn::Application {
-	std::vector<Ball> balls;
-	Dawn::Texture ball_texture;
+	Simulation sim;
+	StepClock clock;
+	SoundQueue sound_queue;
+	FrameGovernor governor;
+	// Every click and reset this session, written out on close
+	Recording recording;
+	const char* recording_path;
+	std::vector<SoundEvent> frame_sounds;
+	// Declared in this order so the thread is gone before the backend is
+	FmodBackend fmod;
+	std::unique_ptr<AudioThread> audio;
+	// Owns the simulation and recording between start() and finish(); gone
+	// before either of them is
+	SimPipeline pipeline;
+	// Drawn ball i is snapshot instance i; they get recoloured whenever the
+	// snapshot's layout_version moves on
+	std::vector<Dawn::Entity> ball_entities;
+	uint32_t synced_layout = (uint32_t)-1;
+#if USE_INSTANCED_BALLS
+	BallRenderer ball_renderer;
+#endif
+	SpriteSheet sprites;
 	Dawn::Scene scene;
 	float countdown = 1.0;
 	Dawn::Vec3 mouse_pos;
-	MatterType next_ball = WHITE_MATTER;
+	// What the cursor was last tinted as
+	MatterType shown_next_ball = WHITE_MATTER;
 	Dawn::Entity cursor;
 
-	std::vector<Dawn::Texture> number_textures;
-	std::vector<Dawn::Entity> number_entities;
+	DigitCounter score_counter;
+	DigitCounter highest_score_counter;
 	int last_score = -1;
 	int highest_score = 0;
 	bool reset_score = false;
-
-	int ball_counts[3] = { 0, 0, 0 };
+	uint32_t seen_resets = 0;
+	int shown_awake = -1;
+	int shown_asleep = -1;
 
 	//Dawn::Entity flash;
 	//Dawn::Texture flash_texture;
 
 public:
-	MatterType whichBallNext() {
-		int total_balls = ball_counts[0] + ball_counts[1] + ball_counts[2];
-		if (total_balls < 5) {
-			// Too small a sample for the complicated stuff, just pick randomly...
-			float rand_value = (float)(rand() % 1000) / 1000;
-			if (rand_value < 0.33) {
-				return WHITE_MATTER;
-			} else if (rand_value < 0.66) {
-				return RED_MATTER;
-			} else {
-				return BLUE_MATTER;
-			}
-		}
-		float proportions[3] = { 0.0f, 0.0f, 0.0f };
-		for (int i = 0; i < 3; i++) {
-			proportions[i] = (float) ball_counts[i] / (float) total_balls;
-		}
-		float deltas[3] = { 0.0f, 0.0f, 0.0f };
-		for (int i = 0; i < 3; i++) {
-			deltas[i] = EXPECTED_PROPORTIONS[i] - proportions[i];
-		}
-		int point_deltas[3] = { 0, 0, 0 };
-		for (int i = 0; i < 3; i++) {
-			// 2% -> 1 chance point
-			point_deltas[i] = trunc(deltas[i] * 50.0f);
-		}
-		int chance_points[3] = { 0, 0, 0 };
-		for (int i = 0; i < 3; i++) {
-			chance_points[i] = BASE_CHANCE_POINTS[i] + point_deltas[i];
-			if (chance_points[i] < 0) {
-				chance_points[i] = 0;
-			}
-		}
-		int total_chance_points = 0;
-		for (int i = 0; i < 3; i++) {
-			total_chance_points += chance_points[i];
-		}
-		// Use chance points to randomly select next ball
-		//std::cout << total_chance_points << "|" << chance_points[0] << " " << chance_points[1] << " " << chance_points[2] << std::endl;
-		float white_boundary = (float)chance_points[0] / (float)total_chance_points;
-		float red_boundary = white_boundary + ((float)chance_points[1] / (float)total_chance_points);
-		float rand_value = (float)(rand() % 1000) / 1000;
-		//std::cout << rand_value << " " << white_boundary << " " << red_boundary << std::endl;
-		if (rand_value < white_boundary) {
-			return WHITE_MATTER;
-		} else if (rand_value < red_boundary) {
-			return RED_MATTER;
-		} else {
-			return BLUE_MATTER;
-		}
-	}
-	int score() {
-		int red  = ball_counts[1];
-		int blue = ball_counts[2];
-		if (red > blue) {
-			return blue;
-		} else {
-			return red;
-		}
-	}
-	void addBall(MatterType type, Dawn::Vec3 pos) {
-		Dawn::Entity ball_entity;
-		ball_entity = scene.addEntity();
-		scene.addComponent<Dawn::TransformComponent>(ball_entity);
-		auto& transform_component = scene.getComponent<Dawn::TransformComponent>(ball_entity);
-		/*
-		transform_component.position = Dawn::Vec3(
-			(2.0f / (k + 1)) * (x + 1) - 1.0f,
-			(2.0f / (k + 1)) * (y + 1) - 1.0f,
-			(y + x * 5) * -0.1
-		);*/
-		transform_component.position = pos;
-		transform_component.scale = Dawn::Vec3(BALL_SIZE, BALL_SIZE, 1);
-
-		scene.addComponent<Dawn::SpriteRendererComponent>(ball_entity);
-		auto& sprite_component = scene.getComponent<Dawn::SpriteRendererComponent>(ball_entity);
-		sprite_component.texture = &ball_texture;
-
-		//MatterType matter = (MatterType)((x + y) % 3);
-		MatterType matter = type;
-		sprite_component.color = BALL_COLORS[((int)matter) % 3];
-
-		Ball ball(&scene, matter, ball_entity, 0.5);
-		//ball.velocity.x = 2.0f - 4.0f * (float)(rand() % 100) / 100.0f;
-		const float START_VELOCITY_SCALE = 0.2f;
-		ball.velocity.x = pos.x * -1.0f * START_VELOCITY_SCALE;
-		balls.insert(balls.begin(), ball);
-		ball_counts[(int)matter]++;
-	}
 	void onClick(const Dawn::Event& evt) {
 		if (evt.getType() != Dawn::EventType::MousePressed) {
 			return;
 		}
-		const auto& mouse_click = (const Dawn::MousePressedEvent&) evt;
-		addBall(next_ball, mouse_pos);
+		// Whatever's next by then gets dropped, and the cursor catches up once
+		// the snapshot says what comes after it
+		pipeline.post({ SIM_CLICK, Vec2(mouse_pos.x, mouse_pos.y) });
 		/*
 		float chance = (float)(rand() % 1000) / 1000.0f;
 		MatterType matter;
@@ -391,11 +247,6 @@ public:
 			matter = BLUE_MATTER;
 		}
 		next_ball = matter;*/
-		next_ball = whichBallNext();
-		auto& sprite_component = scene.getComponent<Dawn::SpriteRendererComponent>(cursor);
-		sprite_component.texture = &ball_texture;
-		sprite_component.color = BALL_COLORS[next_ball];
-		sprite_component.color.w = CURSOR_ALPHA;
 		//next_ball = (MatterType) (((int) next_ball + 1) % 3);
 	}
 	void onMouseMove(const Dawn::Event& evt) {
@@ -430,26 +281,44 @@ public:
 			int highest_score = 0;
 
 			int ball_counts[3] = { 0, 0, 0 };*/
-			for (auto& ball : balls) {
-				scene.deleteEntity(ball.entity);
+			// The scores are zeroed once the snapshot shows the reset happened
+			pipeline.post({ SIM_RESET, Vec2(0, 0) });
+		}
+		// Dump the last few seconds of phase timings for chrome://tracing
+		if (key_press.getKeyCode() == Dawn::KeyCode::P) {
+			if (PROFILE_WRITE_TRACE("trace.json")) {
+				std::cout << "Wrote trace.json" << std::endl;
 			}
-			balls.clear();
-			next_ball = WHITE_MATTER;
-			last_score = 0;
-			highest_score = 0;
-			ball_counts[0] = 0;
-			ball_counts[1] = 0;
-			ball_counts[2] = 0;
-			reset_score = true;
 		}
 	}
-	Game() : mouse_pos(0, 0, 0) {
-		// FMOD
-		{
-			FMOD::System_Create(&fmod_system);
-			fmod_system->init(512, FMOD_INIT_NORMAL, nullptr);
-			fmod_system->createSound("clack.ogg", FMOD_DEFAULT, nullptr, &clack_sound);
-			fmod_system->createSound("thump.ogg", FMOD_DEFAULT, nullptr, &thump_sound);
+	Game(uint32_t seed, const char* recording_path, const char* bundle_path)
+		: sim(seed), recording_path(recording_path), pipeline(sim, recording, PIPELINED_PHYSICS), mouse_pos(0, 0, 0) {
+		recording.seed = seed;
+		auto load_start = std::chrono::steady_clock::now();
+		if (bundle_path && !assets.open(bundle_path)) {
+			std::cout << "No bundle at " << bundle_path << ", loading loose files" << std::endl;
+		}
+
+		// Physics on every core; small scenes fit in one chunk and stay on the
+		// thread that steps. Pipelined, that's the pipeline's thread, working
+		// as the pool's first while this one draws, so leave this thread and
+		// the audio thread a core each rather than have them fight the pool.
+#if PIPELINED_PHYSICS
+		sim.setThreads(std::max((int)std::thread::hardware_concurrency() - 2, 1));
+#else
+		sim.setThreads(0);
+#endif
+		// Exact near explosions, coarse field for far ones (see `headless check`)
+		sim.explosion.mode = EXPLOSION_FIELD;
+		// Everything above is full fidelity; the governor sheds from there,
+		// and a replay starts from there too
+		governor.remember(sim, sound_queue);
+		recording.remember(sim);
+
+		// FMOD starts up and loads its sounds on the audio thread
+		audio.reset(new AudioThread(fmod));
+		if (!audio->isStarted()) {
+			std::cout << "No audio" << std::endl;
 		}
 
 		// No framerate limit
@@ -464,16 +333,14 @@ public:
 		getWindow().setHeight(800);
 		getWindow().setWidth(800);
 
-		// Load texture
-		ball_texture.loadFromFile("Ball.png");
+		// Load textures
+		sprites.load();
+		score_counter.create(scene, sprites, Dawn::Vec3(0.9, 0.9, 0));
+		highest_score_counter.create(scene, sprites, Dawn::Vec3(0.9, 0.9 - 0.15, 0));
 
-		// Number textures
-		number_textures.resize(10);
-		for (int i = 0; i < 10; i++) {
-			char buf[64];
-			sprintf_s(buf, "numbers/%d.png", i);
-			number_textures[i].loadFromFile(buf);
-		}
+		double load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load_start).count();
+		std::cout << "Loaded assets in " << std::fixed << std::setprecision(2) << load_ms << " ms from "
+			<< (assets.isOpen() ? bundle_path : "loose files") << std::endl;
 
 		// Flash
 #if 0
@@ -497,11 +364,17 @@ public:
 		cursor = scene.addEntity();
 		scene.addComponent<Dawn::SpriteRendererComponent>(cursor);
 		auto& sprite_component = scene.getComponent<Dawn::SpriteRendererComponent>(cursor);
-		sprite_component.texture = &ball_texture;
+		sprites.apply(sprite_component, ATLAS_BALL);
 		sprite_component.color = Dawn::Vec4(1.0, 1.0, 1.0, CURSOR_ALPHA);
 		auto& transform_component = scene.getComponent<Dawn::TransformComponent>(cursor);
 		transform_component.scale = Dawn::Vec3(BALL_SIZE, BALL_SIZE, 0);
 
+#if USE_INSTANCED_BALLS
+		if (!ball_renderer.create()) {
+			std::cout << "Couldn't build the ball shaders" << std::endl;
+		}
+#endif
+
 		// Set up balls
 		/*
 		int k = 8;
@@ -512,7 +385,13 @@ public:
 		}*/
 	}
 	void onUpdate() override {
-		fmod_system->update();
+		PROFILE_SCOPE("frame");
+#if PROFILING
+		static int profile_frames = 0;
+		if (PROFILE_SUMMARY_FRAMES > 0 && ++profile_frames % PROFILE_SUMMARY_FRAMES == 0) {
+			PROFILE_PRINT_SUMMARY(stdout);
+		}
+#endif
 
 #if 0
 		{
@@ -531,7 +410,11 @@ public:
 
 		if (countdown >= 0.0) {
 			countdown -= Dawn::Time::deltaTime;
-			scene.onUpdate();
+			// No steps yet, but clicks still land
+			pipeline.start(0, 1.0f);
+			pipeline.finish();
+			syncTransforms(pipeline.front());
+			drawScene(pipeline.front());
 			return;
 		}
 
@@ -541,10 +424,10 @@ public:
             float total_momentum = 0.0;
             float total_kinetic_energy = 0.0;
             float total_potential_energy = 0.0;
-            for (auto& ball : balls) {
-                total_momentum += ball.mass * Magnitude(ball.velocity);
-				total_kinetic_energy += ball.kineticEnergy();
-				total_potential_energy += ball.potentialEnergy();
+            for (int i = 0; i < sim.balls.size(); i++) {
+                total_momentum += sim.balls.mass[i] * Magnitude(sim.balls.getVelocity(i));
+				total_kinetic_energy += sim.balls.kineticEnergy(i);
+				total_potential_energy += sim.balls.potentialEnergy(i);
                 std::cout 
 					<< std::fixed << std::setprecision(3) <<    "p: " << total_momentum 
 					<< std::fixed << std::setprecision(3) << " | E: " << total_kinetic_energy + total_potential_energy
@@ -555,136 +438,156 @@ public:
         }
 #endif
         
+		// Physics runs at a fixed rate whatever the frame rate is; a frame may
+		// run several steps or none. They run while everything below draws
+		// the last frame's batch, so what's on screen is a frame behind.
+		int steps = clock.advance(Dawn::Time::deltaTime);
+		{
+			GovernorScope timer(governor, PHASE_PHYSICS);
+			pipeline.start(steps, clock.alpha());
+		}
+		const SimSnapshot& snapshot = pipeline.front();
+
 		// Show score
-		if (score() != last_score || reset_score) {
+		if (snapshot.resets != seen_resets) {
+			seen_resets = snapshot.resets;
+			highest_score = 0;
+			reset_score = true;
+		}
+		if (snapshot.score != last_score || reset_score) {
 			reset_score = false;
-			last_score = score();
+			last_score = snapshot.score;
 			if (last_score > highest_score) {
 				highest_score = last_score;
 			}
-			for (auto& ent : number_entities) {
-				scene.deleteEntity(ent);
-			}
-			number_entities.clear();
-			{
-				char characters[512];
-				sprintf_s(characters, "%d", last_score);
-				int len = strlen(characters);
-				for (int i = len - 1; i >= 0; i--) {
-					Dawn::Entity ent = scene.addEntity();
-
-					scene.addComponent<Dawn::TransformComponent>(ent);
-					auto& transform = scene.getComponent<Dawn::TransformComponent>(ent);
-					Dawn::Vec3 base_position(0.9, 0.9, 0);
-					transform.position = Dawn::Vec3(base_position.x - (len - i - 1) * 0.08, base_position.y, 0);
-					transform.scale = Dawn::Vec3(0.1, 0.1, 1.0);
-
-					scene.addComponent<Dawn::SpriteRendererComponent>(ent);
-					auto& sprite = scene.getComponent<Dawn::SpriteRendererComponent>(ent);
-					sprite.texture = &number_textures[characters[i] - '0'];
-					//sprite.texture = &number_textures[0];
-					sprite.color = Dawn::Vec4(1.0, 1.0, 1.0, 1.0);
-
-					number_entities.push_back(ent);
-				}
-			}
-			{
-				char characters[512];
-				sprintf_s(characters, "%d", highest_score);
-				int len = strlen(characters);
-				for (int i = len - 1; i >= 0; i--) {
-					Dawn::Entity ent = scene.addEntity();
-
-					scene.addComponent<Dawn::TransformComponent>(ent);
-					auto& transform = scene.getComponent<Dawn::TransformComponent>(ent);
-					Dawn::Vec3 base_position(0.9, 0.9, 0);
-					transform.position = Dawn::Vec3(base_position.x - (len - i - 1) * 0.08, base_position.y - 0.15, 0);
-					transform.scale = Dawn::Vec3(0.1, 0.1, 1.0);
-
-					scene.addComponent<Dawn::SpriteRendererComponent>(ent);
-					auto& sprite = scene.getComponent<Dawn::SpriteRendererComponent>(ent);
-					sprite.texture = &number_textures[characters[i] - '0'];
-					//sprite.texture = &number_textures[0];
-					sprite.color = Dawn::Vec4(1.0, 1.0, 1.0, 1.0);
-
-					number_entities.push_back(ent);
-				}
-			}
+			score_counter.set(scene, sprites, last_score);
+			highest_score_counter.set(scene, sprites, highest_score);
 		}
 
-		// Apply gravity and wall collisions
-        std::for_each(balls.begin(), balls.end(), std::mem_fn(&Ball::tickGravity));
-		std::for_each(balls.begin(), balls.end(), std::mem_fn(&Ball::collideWalls));
+		if (PRINT_SLEEP_COUNTS && (snapshot.awake_count != shown_awake || snapshot.asleep_count != shown_asleep)) {
+			shown_awake = snapshot.awake_count;
+			shown_asleep = snapshot.asleep_count;
+			std::cout << "awake " << shown_awake << " | asleep " << shown_asleep << "        \r" << std::flush;
+		}
 
-		// Collide balls and detect annihilations
-		std::vector<std::tuple<Dawn::Vec3, float>> modifications;
-		modifications.reserve(balls.size());
-		for (int i = 0; i < balls.size(); i++) {
-			modifications.push_back(balls[i].collideBalls(i, balls));
+		{
+			PROFILE_SCOPE("sounds");
+			GovernorScope timer(governor, PHASE_SOUNDS);
+			sound_queue.push(snapshot.sounds.data(), (int)snapshot.sounds.size());
+			sound_queue.flush(frame_sounds);
+			audio->post(frame_sounds);
 		}
-		for (int i = 0; i < balls.size(); i++) {
-			const auto& acceleration = std::get<0>(modifications[i]);
-			// Workaround for NaN issue...
-			if (isnan(acceleration.x) || isnan(acceleration.y) || isnan(acceleration.z)) {
-				std::cout << "NaN detected!" << std::endl;
-				continue;
-			}
-			float energy_loss = std::get<1>(modifications[i]);
-			// Apply accelerations
-			balls[i].velocity = acceleration * PHYSICS_TIMESTEP + balls[i].velocity;
-			// Apply energy loss
-			balls[i].velocity = balls[i].velocity * energy_loss;
-		}
-
-		// Annihilate pairs
-		std::vector<Dawn::Vec3> explosions;
-		for (auto it = balls.begin(); it != balls.end();) {
-			if (it->annihilating) {
-				/*
-				{
-					auto& flash_sprite = scene.getComponent<Dawn::SpriteRendererComponent>(flash);
-					flash_sprite.color.w = 1.0;
-				}*/
-				ball_counts[(int)it->matter]--;
-				explosions.push_back(it->getPos());
-				scene.deleteEntity(it->entity);
-				it = balls.erase(it);
-			} else {
-				it++;
-			}
+
+		{
+			GovernorScope timer(governor, PHASE_SYNC);
+			syncTransforms(snapshot);
+		}
+		{
+			GovernorScope timer(governor, PHASE_SCENE);
+			drawScene(snapshot);
 		}
 
-		// Clean up physics slop
-		std::for_each(balls.begin(), balls.end(), std::mem_fn(&Ball::cleanSlop));
+		// The worker's idle from here to the next start(), so the governor
+		// can change the simulation's settings
+		{
+			GovernorScope timer(governor, PHASE_PHYSICS);
+			pipeline.finish();
+		}
 
-		// Add explosion impulses for next frame
-		for (auto& ball : balls) {
-			Dawn::Vec3 total_accel(0, 0, 0);
-			for (auto& pos : explosions) {
-				auto difference = ball.getPos() - pos;
-				auto force_normal = Normalize(difference);
-				auto distance_sqr = SqrMagnitude(difference);
-				if (distance_sqr == 0) {
-					continue;
-				}
-				float force_scale = 7.0f;
-				auto force = force_scale / distance_sqr;
-				auto acceleration = force / ball.mass;
-				total_accel = total_accel + (force_normal * acceleration);
+		// Shed or restore work for the next frame
+		if (governor.endFrame()) {
+			governor.apply(sim, sound_queue);
+			recording.shed(sim.stepCount(), governor.level);
+			const auto& ms = governor.phase_ms;
+			std::cout << std::endl << std::fixed << std::setprecision(1)
+				<< "shed level " << governor.level << " (" << shedLevelName(governor.level) << ") at " << governor.frame_ms << " ms/frame"
+				<< " | physics " << ms[PHASE_PHYSICS] << " | sounds " << ms[PHASE_SOUNDS]
+				<< " | sync " << ms[PHASE_SYNC] << " | scene " << ms[PHASE_SCENE]
+				<< " | audio queue " << audio->queueDepth() << ", " << audio->droppedCount() << " dropped of " << audio->postedCount() + audio->droppedCount()
+				<< ", worst tick " << audio->worstTickMs() << " ms" << std::endl;
+		}
+	}
+	// The only place ball state reaches the screen, out of a snapshot whose
+	// positions are already interpolated between the last two steps
+	void syncTransforms(const SimSnapshot& snapshot) {
+		PROFILE_SCOPE("sync transforms");
+		if (snapshot.next_ball != shown_next_ball) {
+			shown_next_ball = snapshot.next_ball;
+			auto& sprite_component = scene.getComponent<Dawn::SpriteRendererComponent>(cursor);
+			sprites.apply(sprite_component, ATLAS_BALL);
+			sprite_component.color = BALL_COLORS[shown_next_ball];
+			sprite_component.color.w = CURSOR_ALPHA;
+		}
+#if USE_INSTANCED_BALLS
+		return;
+#endif
+		const BallInstanceBuffer& balls = snapshot.instances;
+		bool relayout = synced_layout != snapshot.layout_version;
+		while ((int)ball_entities.size() < balls.count()) {
+			Dawn::Entity ent = scene.addEntity();
+			scene.addComponent<Dawn::TransformComponent>(ent);
+			auto& transform = scene.getComponent<Dawn::TransformComponent>(ent);
+			transform.scale = Dawn::Vec3(BALL_SIZE, BALL_SIZE, 1);
+			scene.addComponent<Dawn::SpriteRendererComponent>(ent);
+			auto& sprite = scene.getComponent<Dawn::SpriteRendererComponent>(ent);
+			sprites.apply(sprite, ATLAS_BALL);
+			ball_entities.push_back(ent);
+		}
+		while ((int)ball_entities.size() > balls.count()) {
+			scene.deleteEntity(ball_entities.back());
+			ball_entities.pop_back();
+		}
+		for (int i = 0; i < balls.count(); i++) {
+			const BallInstance& ball = balls.data()[i];
+			auto& transform = scene.getComponent<Dawn::TransformComponent>(ball_entities[i]);
+			transform.position.x = ball.x;
+			transform.position.y = ball.y;
+			if (relayout) {
+				auto& sprite = scene.getComponent<Dawn::SpriteRendererComponent>(ball_entities[i]);
+				sprite.color = BALL_COLORS[ball.color % MATTER_COUNT];
 			}
-			ball.explosion_impulse = total_accel;
 		}
-
+		synced_layout = snapshot.layout_version;
+	}
+	void drawScene(const SimSnapshot& snapshot) {
+		PROFILE_SCOPE("scene update");
 		scene.onUpdate();
+#if USE_INSTANCED_BALLS
+		ball_renderer.draw(snapshot.instances, &BALL_COLORS[0].x, (int)BALL_COLORS.size());
+#else
+		(void)snapshot;
+#endif
 	}
 	void onClose() override {
-		// ...
+		recording.steps = sim.stepCount();
+		if (!recording.save(recording_path)) {
+			std::cout << "Couldn't save the recording to " << recording_path << std::endl;
+		}
 	}
 };
 
-int main() {
-	srand(0);
-
-	Game game;
+// Game [--seed N] [--record path] [--bundle path | --loose]
+// Sessions are always recorded, to last_session.rec unless told otherwise;
+// `headless replay <path>` plays one back. Sounds come from assets.bundle
+// (see BundleBuilder.cpp) if it's there, or the loose files with --loose.
+int main(int argc, char** argv) {
+	uint32_t seed = 0;
+	const char* recording_path = "last_session.rec";
+	const char* bundle_path = "assets.bundle";
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--loose") == 0) {
+			bundle_path = nullptr;
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "--seed") == 0) {
+			seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "--record") == 0) {
+			recording_path = argv[++i];
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "--bundle") == 0) {
+			bundle_path = argv[++i];
+		}
+	}
+	Game game(seed, recording_path, bundle_path);
 	game.start();
 }
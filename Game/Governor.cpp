@@ -0,0 +1,67 @@
+#include "Governor.h"
+#include "Profiler.h"
+
+const char* shedLevelName(ShedLevel level) {
+	switch (level) {
+	case SHED_NONE:       return "none";
+	case SHED_SOUNDS:     return "sounds";
+	case SHED_EXPLOSIONS: return "explosions";
+	case SHED_DOZING:     return "dozing";
+	default:              return "?";
+	}
+}
+
+void shedSimulation(ShedLevel level, const ExplosionSettings& full_explosion, Simulation& sim) {
+	sim.explosion = full_explosion;
+	if (level >= SHED_EXPLOSIONS) {
+		sim.explosion.radius = full_explosion.radius * 0.5f;
+		sim.explosion.field_dim = full_explosion.field_dim / 2 + 1;
+	}
+
+	sim.doze_settled = level >= SHED_DOZING;
+}
+
+void FrameGovernor::remember(const Simulation& sim, const SoundQueue& sounds) {
+	full_voice_budget = sounds.voice_budget;
+	full_merge_size = sounds.merge_size;
+	full_explosion = sim.explosion;
+}
+
+void FrameGovernor::record(FramePhase phase, float ms) {
+	current_ms[phase] += ms;
+}
+
+bool FrameGovernor::endFrame() {
+	float total = 0;
+	for (int i = 0; i < PHASE_COUNT; i++) {
+		phase_ms[i] = current_ms[i];
+		current_ms[i] = 0;
+		total += phase_ms[i];
+	}
+	// Smooth it a little so one hitch doesn't count for much
+	frame_ms += (total - frame_ms) * 0.1f;
+	frames_at_level++;
+
+	ShedLevel next = level;
+	if (frame_ms > budget_ms && frames_at_level >= shed_after && level < SHED_LEVEL_COUNT - 1) {
+		next = (ShedLevel)(level + 1);
+	}
+	else if (frame_ms < budget_ms * 0.6f && frames_at_level >= restore_after && level > SHED_NONE) {
+		next = (ShedLevel)(level - 1);
+	}
+	if (next == level) {
+		return false;
+	}
+	level = next;
+	frames_at_level = 0;
+	PROFILE_MARK(shedLevelName(level));
+	return true;
+}
+
+void FrameGovernor::apply(Simulation& sim, SoundQueue& sounds) const {
+	bool shed_sounds = level >= SHED_SOUNDS;
+	sounds.voice_budget = shed_sounds ? full_voice_budget / 4 : full_voice_budget;
+	sounds.merge_size = shed_sounds ? full_merge_size * 2 : full_merge_size;
+
+	shedSimulation(level, full_explosion, sim);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Simulation.h"
+#include "SoundQueue.h"
+
+#include <chrono>
+
+// Watches how long each part of a frame takes and, when frames keep going over
+// budget, sheds work one level at a time in a fixed order. Once frames come in
+// well under budget for a while it steps back towards full fidelity.
+
+enum ShedLevel {
+	SHED_NONE,
+	// Fewer voices, merged over a wider area
+	SHED_SOUNDS,
+	// Smaller exact radius and a coarser force field for explosions
+	SHED_EXPLOSIONS,
+	// Settled balls that aren't asleep yet collide every other step
+	SHED_DOZING,
+	SHED_LEVEL_COUNT
+};
+
+const char* shedLevelName(ShedLevel level);
+
+// The simulation's part of a shed level, starting over from `full_explosion`.
+// Replay applies recorded levels through this too.
+void shedSimulation(ShedLevel level, const ExplosionSettings& full_explosion, Simulation& sim);
+
+enum FramePhase {
+	PHASE_PHYSICS,
+	PHASE_SOUNDS,
+	PHASE_SYNC,
+	PHASE_SCENE,
+	PHASE_COUNT
+};
+
+class FrameGovernor {
+	int frames_at_level = 0;
+	float current_ms[PHASE_COUNT] = {};
+
+	// What full fidelity looks like, taken from whatever the game set up
+	int full_voice_budget = 0;
+	float full_merge_size = 0;
+	ExplosionSettings full_explosion;
+
+public:
+	// Time the measured phases may take per frame. Less than a 60 Hz frame,
+	// since buffer swaps and the driver aren't measured.
+	float budget_ms = 12.0f;
+	// Frames over budget before shedding more, and frames well under it
+	// before restoring
+	int shed_after = 10;
+	int restore_after = 120;
+
+	ShedLevel level = SHED_NONE;
+	// Last frame's phases, and a running average of the whole frame
+	float phase_ms[PHASE_COUNT] = {};
+	float frame_ms = 0;
+
+	void remember(const Simulation& sim, const SoundQueue& sounds);
+	void record(FramePhase phase, float ms);
+	// Call once the frame's phases are in. True if the level changed, in which
+	// case apply() it.
+	bool endFrame();
+	void apply(Simulation& sim, SoundQueue& sounds) const;
+};
+
+// Times the rest of the enclosing block into one phase
+struct GovernorScope {
+	FrameGovernor& governor;
+	FramePhase phase;
+	std::chrono::steady_clock::time_point begin;
+	GovernorScope(FrameGovernor& governor, FramePhase phase)
+		: governor(governor), phase(phase), begin(std::chrono::steady_clock::now()) {}
+	~GovernorScope() {
+		governor.record(phase, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - begin).count());
+	}
+};
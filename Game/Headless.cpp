@@ -0,0 +1,1004 @@
+// Headless benchmark driver for the simulation core. Needs nothing but the
+// simulation sources, e.g.
+//
+//   g++ -O2 -std=c++17 -pthread Simulation.cpp WorkerPool.cpp Kernels.cpp SoundQueue.cpp Profiler.cpp Recording.cpp Governor.cpp Bundle.cpp BallInstances.cpp FastMath.cpp Batch.cpp AudioThread.cpp Pipeline.cpp StepArena.cpp Headless.cpp -o headless
+//   ./headless [steps] [balls] [seed] [threads] [trace.json]
+//   ./headless check
+//   ./headless replay <session.rec> [threads] [steps.csv]
+//   ./headless bundle <assets.bundle>
+//   ./headless batch [worlds] [steps] [threads] [chance w,r,b] [expected w,r,b]
+//   ./headless pipeline [frames] [balls] [draw_ms]
+//
+// threads defaults to 1; 0 means one per core. Given a trace path, the
+// per-phase timings are written there for chrome://tracing as well as
+// summed up on the console. `check` compares the fast paths against the
+// plain versions they replace and fails if they drift (FastMath.h against
+// libm, the broadphase against brute force, sleepers against what holds them
+// up, the audio ring, the sounds through a bundle and a recorded session
+// against its replay included), and reports how far off the deliberately
+// approximate ones are. It reads the sounds, so run it from the Game folder
+// too. `replay` runs a
+// recorded game session flat out and reports step times; the CSV gets a line
+// per step with its time and a state hash, for diffing two builds.
+// `bundle` times loading every asset out of a bundle against reading the same
+// loose files, and fails if any of them differ. Run it from the Game folder.
+// `batch` plays that many games with a scripted player, one per core by
+// default, and sums up how the scores and ball counts came out. The last two
+// override whichBallNext()'s tuning, e.g. `20,40,40 0.2,0.4,0.4`. The
+// profiler is off while it runs, so the worlds don't share anything.
+// `pipeline` plays the same scripted frames through SimPipeline run inline
+// and threaded, with a busy loop of `draw_ms` standing in for drawing, and
+// fails if the two don't end up in the same state.
+
+#include "AudioThread.h"
+#include "BallInstances.h"
+#include "Batch.h"
+#include "Bundle.h"
+#include "FastMath.h"
+#include "Pipeline.h"
+#include "Profiler.h"
+#include "Recording.h"
+#include "Simulation.h"
+#include "SoundQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+static float randomRange(Simulation& sim, float low, float high) {
+	return low + (high - low) * (float)(sim.random() % 100000) / 100000;
+}
+
+// Relative past 1, absolute below it
+static float difference(float a, float b) {
+	if (std::isnan(a) || std::isnan(b)) {
+		return std::isnan(a) && std::isnan(b) ? 0.0f : INFINITY;
+	}
+	return fabsf(a - b) / fmaxf(1.0f, fabsf(a));
+}
+
+// Every kernel the CPU can run against tickGravity() + collideWalls()
+static bool checkKernels() {
+	const float TOLERANCE = 1e-4f;
+	const int BALLS = 4099;
+
+	Simulation sim(1234);
+	BallStore start;
+	for (int i = 0; i < BALLS; i++) {
+		// Plenty of balls poking through walls and corners, some flung by explosions
+		Vec2 pos(randomRange(sim, -1.2f, 1.2f), randomRange(sim, -1.2f, 1.2f));
+		Vec2 velocity(randomRange(sim, -3.0f, 3.0f), randomRange(sim, -3.0f, 3.0f));
+		start.add(WHITE_MATTER, pos, velocity, 0.5);
+		if (sim.random() % 4 == 0) {
+			start.impulse_x[i] = randomRange(sim, -200.0f, 200.0f);
+			start.impulse_y[i] = randomRange(sim, -200.0f, 200.0f);
+		}
+	}
+
+	BallStore reference = start;
+	std::vector<SoundEvent> sounds;
+	for (int i = 0; i < BALLS; i++) {
+		reference.tickGravity(i);
+	}
+	for (int i = 0; i < BALLS; i++) {
+		reference.collideWalls(i, sounds);
+	}
+
+	bool passed = true;
+	for (int level = KERNEL_SCALAR; level <= detectKernelLevel(); level++) {
+		BallStore balls = start;
+		std::vector<WallHit> hits;
+		integrateAndCollideWalls((KernelLevel)level, balls, 0, BALLS, hits);
+
+		float worst = 0;
+		for (int i = 0; i < BALLS; i++) {
+			worst = fmaxf(worst, difference(reference.pos_x[i], balls.pos_x[i]));
+			worst = fmaxf(worst, difference(reference.pos_y[i], balls.pos_y[i]));
+			worst = fmaxf(worst, difference(reference.vel_x[i], balls.vel_x[i]));
+			worst = fmaxf(worst, difference(reference.vel_y[i], balls.vel_y[i]));
+		}
+		// A hit right on the 0.5 speed cutoff can go either way
+		bool ok = worst <= TOLERANCE && std::abs((int)hits.size() - (int)sounds.size()) <= 2;
+		printf("kernel %-6s  max error %.3g  hits %d/%d  %s\n",
+			kernelLevelName((KernelLevel)level), worst, (int)hits.size(), (int)sounds.size(), ok ? "ok" : "FAILED");
+		passed = passed && ok;
+	}
+	return passed;
+}
+
+// The broadphase's contacts against every pair checked by brute force, over a
+// few seeded games with clicks landing on settled piles, threaded and not
+static bool checkContacts() {
+	const int SEEDS = 5;
+	const int STEPS = 600;
+	const int CLICK_STEPS = 10;
+
+	bool passed = true;
+	int steps_checked = 0;
+	int64_t contacts_seen = 0;
+	int64_t carried = 0;
+	int errors = 0;
+	for (uint32_t seed = 1; seed <= SEEDS; seed++) {
+		Simulation sim(seed);
+		sim.setThreads(seed % 2 ? 1 : 4);
+		sim.doze_settled = seed == SEEDS;
+		sim.check_contacts = true;
+		for (int i = 0; i < 150; i++) {
+			sim.spawn({ sim.whichBallNext(), Vec2(randomRange(sim, -0.9f, 0.9f), randomRange(sim, -0.9f, 0.9f)) });
+		}
+		for (int step = 0; step < STEPS; step++) {
+			if (step % CLICK_STEPS == 0) {
+				sim.spawn({ sim.whichBallNext(), Vec2(randomRange(sim, -0.9f, 0.9f), randomRange(sim, 0.5f, 0.9f)) });
+			}
+			sim.step();
+			contacts_seen += sim.contacts.size();
+			carried += sim.carried_contacts;
+			steps_checked++;
+		}
+		errors += sim.contact_errors;
+	}
+	// Resting pairs have to have come up, or half the search went untested
+	passed = errors == 0 && carried > 0;
+	printf("contacts      %d steps, %" PRId64 " contacts, %" PRId64 " carried over, %d missed or doubled  %s\n",
+		steps_checked, contacts_seen, carried, errors, passed ? "ok" : "FAILED");
+	return passed;
+}
+
+// Sleepers that nothing holds up: not against a wall, and not touching
+// anything that leads to one. Piles bob a little apart under the contact
+// force, so anything within a tenth of a ball counts, and a sleeper gets as
+// long to notice its support's gone as it took to settle; after that it's
+// been left floating. A few games of white and red with blues dropped in, so
+// piles go up under and around sleepers and come down again.
+static bool checkSleep() {
+	const int SEEDS = 5;
+	const int STEPS = 8000;
+	const int DROP_STEPS = 400;
+	const int GRACE_STEPS = SLEEP_STEPS;
+	const float TOUCHING = BALL_SIZE * 1.1f;
+
+	int worst = 0;
+	int64_t sleeper_steps = 0;
+	std::vector<int> held_up;
+	std::vector<int> stack;
+	for (uint32_t seed = 1; seed <= SEEDS; seed++) {
+		Simulation sim(seed);
+		sim.explosion.mode = EXPLOSION_FIELD;
+		for (int i = 0; i < 80; i++) {
+			MatterType matter = sim.random() % 2 ? RED_MATTER : WHITE_MATTER;
+			sim.spawn({ matter, Vec2(randomRange(sim, -0.9f, 0.9f), randomRange(sim, -0.9f, 0.9f)) });
+		}
+		// By handle, how many steps in a row each has been floating
+		std::vector<int> floating;
+		for (int step = 0; step < STEPS; step++) {
+			if (step % DROP_STEPS == DROP_STEPS - 1) {
+				sim.spawn({ BLUE_MATTER, Vec2(randomRange(sim, -0.9f, 0.9f), 0.8f) });
+			}
+			sim.step();
+
+			const BallStore& balls = sim.balls;
+			held_up.assign(balls.size(), 0);
+			stack.clear();
+			for (int i = 0; i < balls.size(); i++) {
+				if (againstWall(balls.pos_x[i], balls.pos_y[i])) {
+					held_up[i] = 1;
+					stack.push_back(i);
+				}
+			}
+			while (!stack.empty()) {
+				int i = stack.back();
+				stack.pop_back();
+				for (int j = 0; j < balls.size(); j++) {
+					float d_x = balls.pos_x[i] - balls.pos_x[j];
+					float d_y = balls.pos_y[i] - balls.pos_y[j];
+					if (!held_up[j] && d_x * d_x + d_y * d_y <= TOUCHING * TOUCHING) {
+						held_up[j] = 1;
+						stack.push_back(j);
+					}
+				}
+			}
+			for (int i = 0; i < balls.size(); i++) {
+				BallHandle handle = balls.handle[i];
+				if (handle >= floating.size()) {
+					floating.resize(handle + 1, 0);
+				}
+				bool asleep = balls.flags[i] & BALL_ASLEEP;
+				sleeper_steps += asleep;
+				floating[handle] = asleep && !held_up[i] ? floating[handle] + 1 : 0;
+				worst = std::max(worst, floating[handle]);
+			}
+		}
+	}
+	bool passed = sleeper_steps > 0 && worst <= GRACE_STEPS;
+	printf("sleep         %d steps, %" PRId64 " sleeper-steps, longest unsupported %d steps  %s\n",
+		SEEDS * STEPS, sleeper_steps, worst, passed ? "ok" : "FAILED");
+	return passed;
+}
+
+// The instance buffer the balls get drawn from, against getDrawPos() one ball
+// at a time, and that refilling it doesn't allocate once it's big enough
+static bool checkInstances() {
+	const int BALLS = 5000;
+	const int BUILDS = 1000;
+	const float ALPHA = 0.375f;
+
+	Simulation sim(99);
+	BallStore balls;
+	for (int i = 0; i < BALLS; i++) {
+		Vec2 pos(randomRange(sim, -0.9f, 0.9f), randomRange(sim, -0.9f, 0.9f));
+		balls.add((MatterType)(sim.random() % MATTER_COUNT), pos, Vec2(0, 0), 0.5);
+		// Somewhere else before the last step
+		balls.prev_x[i] = pos.x + randomRange(sim, -0.05f, 0.05f);
+		balls.prev_y[i] = pos.y + randomRange(sim, -0.05f, 0.05f);
+	}
+
+	BallInstanceBuffer instances;
+	instances.build(balls, ALPHA);
+	bool ok = instances.count() == balls.size();
+	for (int i = 0; ok && i < instances.count(); i++) {
+		Vec2 pos = balls.getDrawPos(i, ALPHA);
+		const BallInstance& instance = instances.data()[i];
+		ok = instance.x == pos.x && instance.y == pos.y && instance.scale == BALL_SIZE && instance.color == (uint32_t)balls.matter[i];
+	}
+
+	// Balls going and coming back mustn't touch the storage
+	size_t capacity = instances.capacity();
+	const BallInstance* storage = instances.data();
+	BallStore fewer = balls;
+	for (int i = 0; i < BALLS; i += 2) {
+		fewer.flags[i] |= BALL_REMOVED;
+	}
+	fewer.compact();
+	instances.build(fewer, ALPHA);
+	ok = ok && instances.count() == fewer.size();
+	instances.build(balls, ALPHA);
+	bool reused = instances.capacity() == capacity && instances.data() == storage;
+	ok = ok && reused;
+
+	auto start = std::chrono::steady_clock::now();
+	for (int build = 0; build < BUILDS; build++) {
+		instances.build(balls, ALPHA);
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / BUILDS;
+	printf("instances     %d balls  %.4f ms/build  storage %s  %s\n",
+		balls.size(), ms, reused ? "reused" : "REALLOCATED", ok ? "ok" : "FAILED");
+	return ok;
+}
+
+// FastMath.h against libm, worked out in double, over the whole range each one
+// gets used on, and that nothing odd going in brings a NaN out
+static bool checkFastMath() {
+	const int SAMPLES = 1 << 20;
+
+	// Log-spaced over far more than distances and speeds ever cover
+	std::vector<float> inputs(SAMPLES);
+	std::vector<float> batch(SAMPLES);
+	for (int i = 0; i < SAMPLES; i++) {
+		inputs[i] = (float)pow(10.0, -12.0 + 24.0 * i / (SAMPLES - 1));
+	}
+	fastRsqrtBatch(inputs.data(), batch.data(), SAMPLES);
+	double rsqrt_error = 0;
+	double sqrt_error = 0;
+	bool batch_matches = true;
+	for (int i = 0; i < SAMPLES; i++) {
+		double x = inputs[i];
+		rsqrt_error = fmax(rsqrt_error, fabs(fastRsqrt(inputs[i]) * sqrt(x) - 1.0));
+		sqrt_error = fmax(sqrt_error, fabs(fastSqrt(inputs[i]) / sqrt(x) - 1.0));
+		batch_matches = batch_matches && batch[i] == fastRsqrt(inputs[i]);
+	}
+
+	double acos_error = 0;
+	for (int i = 0; i < SAMPLES; i++) {
+		float x = -1.0f + 2.0f * i / (SAMPLES - 1);
+		acos_error = fmax(acos_error, fabs(fastAcos(x) - acos((double)x)));
+	}
+
+	// None of these may come out NaN
+	const float odd[] = { 0.0f, -0.0f, -1.0f, 1e-45f, FLT_MIN, FLT_MAX, INFINITY, -INFINITY, NAN };
+	bool nan_free = true;
+	for (float a : odd) {
+		nan_free = nan_free && !std::isnan(fastRsqrt(a)) && !std::isnan(fastSqrt(a)) && !std::isnan(fastAcos(a));
+		for (float b : odd) {
+			Vec2 normal = SafeNorm(Vec2(a, b));
+			nan_free = nan_free && !std::isnan(normal.x) && !std::isnan(normal.y);
+		}
+	}
+	Vec2 unit = SafeNorm(Vec2(3e-19f, -4e-19f));
+	double norm_error = fabs(sqrt((double)unit.x * unit.x + (double)unit.y * unit.y) - 1.0);
+
+	bool ok = rsqrt_error <= FAST_RSQRT_ERROR && sqrt_error <= FAST_RSQRT_ERROR && acos_error <= FAST_ACOS_ERROR &&
+		norm_error <= FAST_RSQRT_ERROR * 2 && batch_matches && nan_free;
+	printf("fast math     rsqrt %.3g  sqrt %.3g  (bound %.3g)  acos %.3g rad (bound %.3g)  batch %s  NaN-free %s  %s\n",
+		rsqrt_error, sqrt_error, FAST_RSQRT_ERROR, acos_error, FAST_ACOS_ERROR,
+		batch_matches ? "same" : "DIFFERS", nan_free ? "yes" : "NO", ok ? "ok" : "FAILED");
+	return ok;
+}
+
+// Stands in for FMOD, with an update tick that can be made to stall
+struct CountingBackend : AudioBackend {
+	int stall_ms = 0;
+	int64_t played = 0;
+	bool start() override {
+		return true;
+	}
+	void play(const PlayCommand*, int count) override {
+		played += count;
+	}
+	void update() override {
+		std::this_thread::sleep_for(std::chrono::milliseconds(stall_ms));
+	}
+	void stop() override {}
+};
+
+// The ring hammered from two threads, and the audio thread behind a backend
+// that stalls, which mustn't hold up posting
+static bool checkAudio() {
+	const int COMMANDS = 1 << 20;
+	SoundRing ring(64);
+	bool in_order = true;
+	int popped = 0;
+	std::thread consumer([&]() {
+		PlayCommand batch[16];
+		float last = -1;
+		while (last < COMMANDS - 1) {
+			int count = ring.pop(batch, 16);
+			for (int i = 0; i < count; i++) {
+				in_order = in_order && batch[i].volume > last;
+				last = batch[i].volume;
+			}
+			popped += count;
+			if (count == 0) {
+				std::this_thread::yield();
+			}
+		}
+	});
+	for (int i = 0; i < COMMANDS; i++) {
+		// Mostly waits for room, but every eighth is let drop. The last one
+		// has to get through, so the consumer knows to stop.
+		while (!ring.push({ SOUND_CLACK, (float)i }) && (i % 8 != 0 || i == COMMANDS - 1)) {
+			std::this_thread::yield();
+		}
+	}
+	consumer.join();
+	bool counted = (uint64_t)popped == ring.pushedCount() && ring.pushedCount() + ring.droppedCount() >= (uint64_t)COMMANDS;
+
+	const int FRAMES = 100;
+	CountingBackend backend;
+	backend.stall_ms = 50;
+	std::vector<SoundEvent> frame(16, { SOUND_THUMP, 0.5f, Vec2(0, 0) });
+	double worst_post_ms = 0;
+	uint64_t posted;
+	uint64_t dropped;
+	double worst_tick_ms;
+	{
+		AudioThread audio(backend);
+		for (int i = 0; i < FRAMES; i++) {
+			auto start = std::chrono::steady_clock::now();
+			audio.post(frame);
+			worst_post_ms = fmax(worst_post_ms, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		posted = audio.postedCount();
+		dropped = audio.droppedCount();
+		worst_tick_ms = audio.worstTickMs();
+	}
+	// Everything that got into the ring was played before the thread quit
+	bool drained = backend.played == (int64_t)posted && posted + dropped == (uint64_t)FRAMES * frame.size();
+
+	bool ok = in_order && counted && drained;
+	printf("audio ring    %d pushed, %d dropped, %s  stalled backend: worst post %.4f ms, worst tick %.1f ms, %d of %d dropped  %s\n",
+		(int)ring.pushedCount(), (int)ring.droppedCount(), in_order ? "in order" : "OUT OF ORDER",
+		worst_post_ms, worst_tick_ms, (int)dropped, FRAMES * (int)frame.size(), ok ? "ok" : "FAILED");
+	return ok;
+}
+
+static uint64_t touch(const uint8_t* data, size_t size) {
+	uint64_t sum = 0;
+	for (size_t i = 0; i < size; i++) {
+		sum += data[i];
+	}
+	return sum;
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>& contents) {
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	contents.resize(ftell(file));
+	fseek(file, 0, SEEK_SET);
+	contents.resize(fread(contents.data(), 1, contents.size(), file));
+	fclose(file);
+	return true;
+}
+
+// Keeps pointers into the bundle the way FMOD does with
+// FMOD_OPENMEMORY_POINT: looked up in start() on the audio thread, and read
+// from on every play until stop()
+struct PointBackend : AudioBackend {
+	const Bundle& assets;
+	const uint8_t* sounds[2] = {};
+	uint64_t sizes[2] = {};
+	uint64_t sums[2] = {};
+	int64_t played = 0;
+	int64_t changed = 0;
+	PointBackend(const Bundle& assets) : assets(assets) {}
+	bool start() override {
+		for (int i = 0; i < 2; i++) {
+			if (const BundleEntry* entry = assets.find(SOUND_FILES[i])) {
+				sounds[i] = assets.data(*entry);
+				sizes[i] = entry->size;
+				sums[i] = touch(sounds[i], sizes[i]);
+			}
+		}
+		return sounds[0] && sounds[1];
+	}
+	void play(const PlayCommand* commands, int count) override {
+		for (int i = 0; i < count; i++) {
+			int sound = commands[i].type;
+			changed += touch(sounds[sound], sizes[sound]) != sums[sound];
+		}
+		played += count;
+	}
+	void update() override {}
+	void stop() override {
+		for (int i = 0; i < 2; i++) {
+			changed += touch(sounds[i], sizes[i]) != sums[i];
+		}
+	}
+};
+
+// The sounds packed into a bundle and mapped back, the way the game gets
+// them: every one the same bytes as its loose file, starting on a
+// BUNDLE_ALIGNMENT boundary in memory as well as in the file, and still
+// there for as long as the audio thread has them. Reads the loose files, so
+// run it from the Game folder.
+static bool checkBundle() {
+	const char* path = "check.bundle";
+	std::vector<BundleAsset> assets(2);
+	for (int i = 0; i < 2; i++) {
+		assets[i].name = SOUND_FILES[i];
+		if (!readFile(SOUND_FILES[i], assets[i].contents)) {
+			printf("bundle        couldn't read %s, run it from the Game folder  FAILED\n", SOUND_FILES[i]);
+			return false;
+		}
+	}
+	std::sort(assets.begin(), assets.end(), [](const BundleAsset& a, const BundleAsset& b) {
+		return a.name < b.name;
+	});
+	if (!writeBundle(path, assets)) {
+		printf("bundle        couldn't write %s  FAILED\n", path);
+		return false;
+	}
+
+	const int FRAMES = 50;
+	bool same = true;
+	bool aligned = true;
+	bool started;
+	int64_t played;
+	int64_t changed;
+	{
+		// Opened before the audio thread and closed after it, as in Game.cpp
+		Bundle bundle;
+		bool opened = bundle.open(path);
+		for (const auto& asset : assets) {
+			const BundleEntry* entry = opened ? bundle.find(asset.name.c_str()) : nullptr;
+			if (!entry) {
+				same = false;
+				continue;
+			}
+			const uint8_t* data = bundle.data(*entry);
+			aligned = aligned && entry->offset % BUNDLE_ALIGNMENT == 0 && (uintptr_t)data % BUNDLE_ALIGNMENT == 0;
+			same = same && entry->size == asset.contents.size() && memcmp(data, asset.contents.data(), entry->size) == 0;
+		}
+		PointBackend backend(bundle);
+		{
+			AudioThread audio(backend);
+			started = audio.isStarted();
+			std::vector<SoundEvent> frame = { { SOUND_CLACK, 0.5f, Vec2(0, 0) }, { SOUND_THUMP, 0.5f, Vec2(0, 0) } };
+			for (int i = 0; i < FRAMES; i++) {
+				audio.post(frame);
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+		played = backend.played;
+		changed = backend.changed;
+	}
+	remove(path);
+
+	bool ok = same && aligned && started && played == FRAMES * 2 && changed == 0;
+	printf("bundle        %d sounds %s, %s, %d of %d played from the mapping, %d changed under it  %s\n",
+		(int)assets.size(), same ? "round trip" : "DIFFER", aligned ? "aligned" : "NOT ALIGNED",
+		(int)played, FRAMES * 2, (int)changed, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+// How far the cheaper explosion modes drift from the exact sum. Lossy by
+// design, so this only reports.
+static void checkExplosions() {
+	const int BALLS = 5000;
+	const int EXPLOSIONS = 300;
+
+	Simulation sim(99);
+	for (int i = 0; i < BALLS; i++) {
+		sim.spawn({ WHITE_MATTER, Vec2(randomRange(sim, -0.9f, 0.9f), randomRange(sim, -0.9f, 0.9f)) });
+	}
+	// A chain reaction going off across the bottom half
+	for (int e = 0; e < EXPLOSIONS; e++) {
+		sim.explosions.push_back(Vec2(randomRange(sim, -0.9f, 0.9f), randomRange(sim, -0.9f, 0.0f)));
+	}
+
+	sim.explosion.mode = EXPLOSION_EXACT;
+	auto start = std::chrono::steady_clock::now();
+	sim.applyExplosions();
+	double exact_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::vector<float> exact_x = sim.balls.impulse_x;
+	std::vector<float> exact_y = sim.balls.impulse_y;
+	printf("explosions exact    %7.2f ms  (radius %.2f, fade %.2f, field %d)\n",
+		exact_ms, sim.explosion.radius, sim.explosion.fade, sim.explosion.field_dim);
+
+	for (int mode = EXPLOSION_BOUNDED; mode <= EXPLOSION_FIELD; mode++) {
+		sim.explosion.mode = (ExplosionMode)mode;
+		start = std::chrono::steady_clock::now();
+		sim.applyExplosions();
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		// Per ball, how far off the impulse is relative to the exact one
+		std::vector<float> errors(BALLS);
+		for (int i = 0; i < BALLS; i++) {
+			Vec2 exact(exact_x[i], exact_y[i]);
+			Vec2 approx(sim.balls.impulse_x[i], sim.balls.impulse_y[i]);
+			errors[i] = Magnitude(approx - exact) / fmaxf(Magnitude(exact), 1e-6f);
+		}
+		std::sort(errors.begin(), errors.end());
+		printf("explosions %-8s %7.2f ms  relative error p50 %.3f p95 %.3f max %.3f\n",
+			mode == EXPLOSION_BOUNDED ? "bounded" : "field", ms,
+			errors[BALLS / 2], errors[BALLS * 95 / 100], errors[BALLS - 1]);
+	}
+}
+
+static uint64_t replayChecksum(const Recording& recording, int threads, int& balls) {
+	Simulation sim(recording.seed);
+	sim.setThreads(threads);
+	Replay replay(recording, sim);
+	while (!replay.done()) {
+		replay.advance();
+	}
+	balls = sim.balls.size();
+	return sim.checksum();
+}
+
+// A session recorded the way the game records one: stepped through
+// SimPipeline with FIELD explosions, the governor shedding and restoring as
+// it goes. Saved, loaded and replayed, it has to end up exactly where the
+// session did. Replayed without its settings it mustn't, or the session
+// never leaned on them.
+static bool checkReplay() {
+	const int FRAMES = 1200;
+	const int SHED_FRAMES = 150;
+	const ShedLevel LEVELS[] = { SHED_SOUNDS, SHED_EXPLOSIONS, SHED_DOZING, SHED_EXPLOSIONS, SHED_NONE, SHED_DOZING, SHED_SOUNDS, SHED_NONE };
+	const char* PATH = "headless_check.rec";
+
+	Simulation sim(7);
+	sim.explosion.mode = EXPLOSION_FIELD;
+	SoundQueue sounds;
+	FrameGovernor governor;
+	Recording recording;
+	recording.seed = 7;
+	governor.remember(sim, sounds);
+	recording.remember(sim);
+	{
+		SimPipeline pipeline(sim, recording, true);
+		for (int frame = 0; frame < FRAMES; frame++) {
+			// Not sim.random(), which belongs to the worker until finish()
+			if (frame % 5 == 0) {
+				float x = -0.9f + 1.8f * (float)((frame * 7919) % 1000) / 1000;
+				pipeline.post({ SIM_CLICK, Vec2(x, 0.8f) });
+			}
+			if (frame == FRAMES / 2) {
+				pipeline.post({ SIM_RESET, Vec2(0, 0) });
+			}
+			// Frames of 0 to 2 steps, like a frame rate that wanders
+			pipeline.start(frame % 3, 1.0f);
+			pipeline.finish();
+			if (frame % SHED_FRAMES == SHED_FRAMES - 1) {
+				governor.level = LEVELS[frame / SHED_FRAMES];
+				governor.apply(sim, sounds);
+				recording.shed(sim.stepCount(), governor.level);
+			}
+		}
+	}
+	recording.steps = sim.stepCount();
+
+	Recording loaded;
+	bool saved = recording.save(PATH) && loaded.load(PATH);
+	remove(PATH);
+	int balls = 0;
+	uint64_t replayed = saved ? replayChecksum(loaded, 4, balls) : 0;
+
+	Recording bare = loaded;
+	bare.explosion = ExplosionSettings();
+	bare.events.clear();
+	for (const auto& event : loaded.events) {
+		if (event.type != EVENT_SHED) {
+			bare.events.push_back(event);
+		}
+	}
+	int bare_balls = 0;
+	uint64_t without_settings = replayChecksum(bare, 1, bare_balls);
+
+	bool ok = saved && replayed == sim.checksum() && balls == sim.balls.size() && without_settings != sim.checksum();
+	printf("replay        %u steps, %d events  session %016" PRIx64 " (%d balls)  replay %016" PRIx64 " (%d balls)  without settings %016" PRIx64 "  %s\n",
+		recording.steps, (int)recording.events.size(), sim.checksum(), sim.balls.size(), replayed, balls, without_settings, ok ? "ok" : "FAILED");
+	return ok;
+}
+
+static int replay(const char* path, int threads, const char* csv_path) {
+	Recording recording;
+	if (!recording.load(path)) {
+		printf("couldn't read %s\n", path);
+		return 1;
+	}
+	FILE* csv = nullptr;
+	if (csv_path) {
+		csv = fopen(csv_path, "w");
+		if (!csv) {
+			printf("couldn't write %s\n", csv_path);
+			return 1;
+		}
+		fprintf(csv, "step,ms,balls,checksum\n");
+	}
+
+	Simulation sim(recording.seed);
+	sim.setThreads(threads);
+	Replay replay(recording, sim);
+	std::vector<double> step_ms;
+	step_ms.reserve(recording.steps);
+	while (!replay.done()) {
+		auto start = std::chrono::steady_clock::now();
+		replay.advance();
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		step_ms.push_back(ms);
+		if (csv) {
+			fprintf(csv, "%u,%.4f,%d,%016" PRIx64 "\n", replay.step, ms, sim.balls.size(), sim.checksum());
+		}
+	}
+	if (csv) {
+		fclose(csv);
+	}
+
+	double total = 0;
+	for (double ms : step_ms) {
+		total += ms;
+	}
+	std::sort(step_ms.begin(), step_ms.end());
+	size_t count = step_ms.size();
+	const char* MODE_NAMES[] = { "exact", "bounded", "field" };
+	printf("recording:      %s (seed %u, %d events)\n", path, recording.seed, (int)recording.events.size());
+	printf("explosions:     %s, radius %.2f, fade %.2f, field %d%s\n", MODE_NAMES[recording.explosion.mode],
+		recording.explosion.radius, recording.explosion.fade, recording.explosion.field_dim, recording.doze_settled ? ", dozing" : "");
+	printf("kernel:         %s\n", kernelLevelName(sim.kernel_level));
+	printf("steps:          %d\n", (int)count);
+	if (count > 0) {
+		printf("total:          %.1f ms\n", total);
+		printf("step ms:        p50 %.3f  p99 %.3f  max %.3f\n", step_ms[count / 2], step_ms[count * 99 / 100], step_ms[count - 1]);
+	}
+	printf("balls:          %d\n", sim.balls.size());
+	printf("score:          %d\n", sim.score());
+	printf("checksum:       %016" PRIx64 "\n", sim.checksum());
+	return 0;
+}
+
+// Open, look up and read every asset, the way startup does, both ways round
+static int compareBundle(const char* path) {
+	static const int RUNS = 200;
+	Bundle bundle;
+	if (!bundle.open(path)) {
+		printf("couldn't read %s\n", path);
+		return 1;
+	}
+	std::vector<std::string> names;
+	for (uint32_t i = 0; i < bundle.size(); i++) {
+		names.push_back(bundle.entry(i).name);
+	}
+	bundle.close();
+
+	bool matched = true;
+	uint64_t bundle_sum = 0;
+	uint64_t loose_sum = 0;
+	std::vector<uint8_t> contents;
+	auto start = std::chrono::steady_clock::now();
+	for (int run = 0; run < RUNS; run++) {
+		Bundle assets;
+		assets.open(path);
+		for (const auto& name : names) {
+			const BundleEntry* entry = assets.find(name.c_str());
+			bundle_sum += touch(assets.data(*entry), entry->size);
+		}
+	}
+	double bundle_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / RUNS;
+
+	start = std::chrono::steady_clock::now();
+	for (int run = 0; run < RUNS; run++) {
+		for (const auto& name : names) {
+			if (!readFile(name.c_str(), contents)) {
+				printf("couldn't read %s\n", name.c_str());
+				return 1;
+			}
+			loose_sum += touch(contents.data(), contents.size());
+		}
+	}
+	double loose_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / RUNS;
+
+	bundle.open(path);
+	for (const auto& name : names) {
+		const BundleEntry* entry = bundle.find(name.c_str());
+		FILE* file = fopen(name.c_str(), "rb");
+		contents.assign(entry->size + 1, 0);
+		size_t got = fread(contents.data(), 1, contents.size(), file);
+		fclose(file);
+		if (got != entry->size || memcmp(contents.data(), bundle.data(*entry), got) != 0) {
+			printf("FAIL %s differs from the bundle\n", name.c_str());
+			matched = false;
+		}
+	}
+
+	printf("assets:         %d\n", (int)names.size());
+	printf("bundle:         %.3f ms\n", bundle_ms);
+	printf("loose files:    %.3f ms\n", loose_ms);
+	printf("same bytes:     %s\n", matched && bundle_sum == loose_sum ? "yes" : "no");
+	return matched && bundle_sum == loose_sum ? 0 : 1;
+}
+
+static void printDistribution(const char* name, std::vector<double> values) {
+	Distribution d = distributionOf(values);
+	printf("%-14s %7.2f %7.2f %6.0f %6.0f %6.0f %6.0f %6.0f\n", name, d.mean, d.stddev, d.min, d.p10, d.p50, d.p90, d.max);
+}
+
+static void printDistribution(const char* name, const std::vector<WorldResult>& results, double (*value)(const WorldResult&)) {
+	std::vector<double> values;
+	for (const auto& result : results) {
+		values.push_back(value(result));
+	}
+	printDistribution(name, values);
+}
+
+// "20,40,40", one per matter type
+template<class T>
+static bool parseMatterList(const char* text, T* values) {
+	for (int i = 0; i < MATTER_COUNT; i++) {
+		char* end;
+		double value = strtod(text, &end);
+		if (end == text || *end != (i + 1 < MATTER_COUNT ? ',' : '\0')) {
+			return false;
+		}
+		values[i] = (T)value;
+		text = end + 1;
+	}
+	return true;
+}
+
+template<class T>
+static void printMatterList(const char* label, const char* format, const T* values) {
+	printf("%-16s", label);
+	for (int i = 0; i < MATTER_COUNT; i++) {
+		printf(i > 0 ? " / " : "");
+		printf(format, values[i]);
+	}
+	printf("\n");
+}
+
+static int batch(int argc, char** argv) {
+	BatchSettings settings;
+	settings.worlds = argc > 2 ? atoi(argv[2]) : settings.worlds;
+	settings.steps = argc > 3 ? atoi(argv[3]) : settings.steps;
+	settings.threads = argc > 4 ? atoi(argv[4]) : settings.threads;
+	SpawnTuning& tuning = settings.tuning;
+	if (argc > 5 && !parseMatterList(argv[5], tuning.base_chance_points)) {
+		printf("chance points should be one per matter type, like 20,40,40\n");
+		return 1;
+	}
+	if (argc > 6 && !parseMatterList(argv[6], tuning.expected_proportions)) {
+		printf("expected proportions should be one per matter type, like 0.2,0.4,0.4\n");
+		return 1;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<WorldResult> results = runBatch(settings);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("worlds:         %d (seeds %u to %u)\n", settings.worlds, settings.first_seed, settings.first_seed + settings.worlds - 1);
+	printf("steps:          %d, a click every %d\n", settings.steps, settings.clicks.click_steps);
+	printMatterList("chance points:", "%d", tuning.base_chance_points);
+	printMatterList("expected:", "%.2f", tuning.expected_proportions);
+	printf("threads:        %d\n", settings.threads > 0 ? settings.threads : (int)std::thread::hardware_concurrency());
+	printf("worlds/sec:     %.2f\n", settings.worlds / seconds);
+	printf("\n               mean  stddev    min    p10    p50    p90    max\n");
+	printDistribution("score", results, [](const WorldResult& r) { return (double)r.score; });
+	printDistribution("best score", results, [](const WorldResult& r) { return (double)r.best_score; });
+	for (int i = 0; i < MATTER_COUNT; i++) {
+		std::vector<double> counts;
+		for (const auto& result : results) {
+			counts.push_back(result.ball_counts[i]);
+		}
+		printDistribution(MATTER_INFO[i].name, counts);
+	}
+	printDistribution("balls", results, [](const WorldResult& r) { return (double)r.balls; });
+
+	// Worlds come back in seed order, so this should match whatever the thread count
+	uint64_t hash = 14695981039346656037ull;
+	for (const auto& result : results) {
+		hash = (hash ^ (uint32_t)result.score) * 1099511628211ull;
+		hash = (hash ^ (uint32_t)result.best_score) * 1099511628211ull;
+		for (int value : result.ball_counts) {
+			hash = (hash ^ (uint32_t)value) * 1099511628211ull;
+		}
+	}
+	printf("\nresults hash:   %016" PRIx64 "\n", hash);
+	return 0;
+}
+
+// Somewhere for the pretend drawing to go, so it isn't optimised out
+static volatile float draw_sink;
+
+struct PipelineRun {
+	double frame_ms;
+	double physics_ms;
+	uint64_t checksum;
+	size_t events;
+};
+
+static PipelineRun runPipeline(bool threaded, int frames, int ball_count, double draw_ms) {
+	Simulation sim(7);
+	sim.explosion.mode = EXPLOSION_FIELD;
+	Recording recording;
+	SimPipeline pipeline(sim, recording, threaded);
+	// Clicks come from their own sequence so they're the same both runs
+	Simulation script(8);
+	auto click = [&]() {
+		pipeline.post({ SIM_CLICK, Vec2(randomRange(script, -0.9f, 0.9f), randomRange(script, -0.1f, 0.9f)) });
+	};
+	for (int i = 0; i < ball_count; i++) {
+		click();
+	}
+
+	StepClock clock;
+	double physics_ms = 0;
+	float sink = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < frames; frame++) {
+		if (frame % 20 == 0) {
+			click();
+		}
+		if (frame == frames * 3 / 4) {
+			pipeline.post({ SIM_RESET, Vec2(0, 0) });
+		}
+		// Uneven frames, so some run two steps and some none
+		int steps = clock.advance(frame % 3 == 0 ? 1.0f / 30.0f : 1.0f / 80.0f);
+		pipeline.start(steps, clock.alpha());
+
+		// Drawing: read the snapshot over and over for `draw_ms`
+		const SimSnapshot& snapshot = pipeline.front();
+		auto draw_start = std::chrono::steady_clock::now();
+		while (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - draw_start).count() < draw_ms) {
+			for (int i = 0; i < snapshot.instances.count(); i++) {
+				sink += snapshot.instances.data()[i].x;
+			}
+		}
+		pipeline.finish();
+		physics_ms += pipeline.front().physics_ms;
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	draw_sink = sink;
+	return { ms / frames, physics_ms / frames, sim.checksum(), recording.events.size() };
+}
+
+static int comparePipeline(int frames, int ball_count, double draw_ms) {
+	PipelineRun serial = runPipeline(false, frames, ball_count, draw_ms);
+	PipelineRun pipelined = runPipeline(true, frames, ball_count, draw_ms);
+	bool same = serial.checksum == pipelined.checksum && serial.events == pipelined.events;
+	printf("frames:         %d, %d balls to start, %.1f ms drawing each\n", frames, ball_count, draw_ms);
+	printf("cores:          %d\n", (int)std::thread::hardware_concurrency());
+	printf("one by one:     %.2f ms/frame (physics %.2f)\n", serial.frame_ms, serial.physics_ms);
+	printf("pipelined:      %.2f ms/frame (physics %.2f)\n", pipelined.frame_ms, pipelined.physics_ms);
+	printf("same result:    %s (%016" PRIx64 ", %d events recorded)\n", same ? "yes" : "NO", pipelined.checksum, (int)pipelined.events);
+	return same ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+	if (argc > 1 && strcmp(argv[1], "check") == 0) {
+		bool passed = checkKernels();
+		passed = checkContacts() && passed;
+		passed = checkSleep() && passed;
+		passed = checkInstances() && passed;
+		passed = checkFastMath() && passed;
+		passed = checkAudio() && passed;
+		passed = checkBundle() && passed;
+		passed = checkReplay() && passed;
+		checkExplosions();
+		return passed ? 0 : 1;
+	}
+	if (argc > 2 && strcmp(argv[1], "replay") == 0) {
+		return replay(argv[2], argc > 3 ? atoi(argv[3]) : 1, argc > 4 ? argv[4] : nullptr);
+	}
+	if (argc > 2 && strcmp(argv[1], "bundle") == 0) {
+		return compareBundle(argv[2]);
+	}
+	if (argc > 1 && strcmp(argv[1], "batch") == 0) {
+		return batch(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "pipeline") == 0) {
+		return comparePipeline(argc > 2 ? atoi(argv[2]) : 600, argc > 3 ? atoi(argv[3]) : 300, argc > 4 ? atof(argv[4]) : 4.0);
+	}
+
+	int steps      = argc > 1 ? atoi(argv[1]) : 1000;
+	int ball_count = argc > 2 ? atoi(argv[2]) : 500;
+	uint32_t seed  = argc > 3 ? (uint32_t)strtoul(argv[3], nullptr, 10) : 0;
+	int threads    = argc > 4 ? atoi(argv[4]) : 1;
+	const char* trace_path = argc > 5 ? argv[5] : nullptr;
+
+	Simulation sim(seed);
+	sim.setThreads(threads);
+
+	// Scatter the balls over the part of the arena a player could click on
+	for (int i = 0; i < ball_count; i++) {
+		SpawnCommand command;
+		command.matter = sim.whichBallNext();
+		command.pos.x = -0.9f + 1.8f * (float)(sim.random() % 1000) / 1000;
+		command.pos.y = -0.1f + 1.0f * (float)(sim.random() % 1000) / 1000;
+		sim.spawn(command);
+	}
+
+	SoundQueue sound_queue;
+	std::vector<SoundEvent> played;
+	int64_t sounds_raised = 0;
+	int64_t sounds_played = 0;
+
+	int64_t ball_steps = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < steps; i++) {
+		ball_steps += sim.balls.size();
+		sim.step();
+		PROFILE_SCOPE("sounds");
+		sound_queue.push(sim.sounds.begin(), sim.sounds.size());
+		sound_queue.flush(played);
+		sounds_raised += sound_queue.last_pushed;
+		sounds_played += sound_queue.last_played;
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	double seconds = std::chrono::duration<double>(end - start).count();
+	printf("kernel:         %s\n", kernelLevelName(sim.kernel_level));
+	printf("steps:          %d\n", steps);
+	printf("balls:          %d -> %d\n", ball_count, sim.balls.size());
+	printf("steps/sec:      %.1f\n", steps / seconds);
+	printf("ns/ball-step:   %.2f\n", ball_steps > 0 ? seconds * 1e9 / ball_steps : 0.0);
+	printf("awake/asleep:   %d / %d\n", sim.awake_count, sim.asleep_count);
+	const StepArena& arena = sim.stepArena();
+	printf("step scratch:   %.1f KB high water, %d heap allocations in %d steps\n",
+		arena.high_water / 1024.0, (int)(arena.total_heap_allocations + arena.last_heap_allocations), steps);
+	printf("sounds/step:    %.1f raised, %.1f played\n", (double)sounds_raised / steps, (double)sounds_played / steps);
+	printf("score:          %d\n", sim.score());
+	printf("checksum:       %016" PRIx64 "\n", sim.checksum());
+
+	if (trace_path) {
+#if PROFILING
+		PROFILE_PRINT_SUMMARY(stdout);
+		if (!PROFILE_WRITE_TRACE(trace_path)) {
+			printf("couldn't write %s\n", trace_path);
+		}
+#else
+		printf("built with PROFILING=0, no trace\n");
+#endif
+	}
+	return 0;
+}
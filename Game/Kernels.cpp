@@ -0,0 +1,323 @@
+#include "Kernels.h"
+
+#include "Simulation.h"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define KERNEL_TARGET_AVX2
+#else
+#define KERNEL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define KERNELS_X86 0
+#endif
+
+KernelLevel detectKernelLevel() {
+#if KERNELS_X86
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	bool os_saves_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+	__cpuidex(info, 7, 0);
+	if (os_saves_avx && (info[1] & (1 << 5))) {
+		return KERNEL_AVX2;
+	}
+#else
+	if (__builtin_cpu_supports("avx2")) {
+		return KERNEL_AVX2;
+	}
+#endif
+	// SSE2 is part of x86-64, and we don't ship for anything older
+	return KERNEL_SSE2;
+#else
+	return KERNEL_SCALAR;
+#endif
+}
+
+const char* kernelLevelName(KernelLevel level) {
+	switch (level) {
+	case KERNEL_SSE2: return "sse2";
+	case KERNEL_AVX2: return "avx2";
+	default:          return "scalar";
+	}
+}
+
+static const float HALF_BALL = BALL_SIZE / 2;
+
+// One ball, the same sums the wide kernels do lane by lane. Also finishes off
+// whatever is left over at the end of a run.
+static void integrateWallsScalar(BallStore& balls, int i, std::vector<WallHit>& hits) {
+	const float d_time = PHYSICS_TIMESTEP;
+
+	float accel_x = ACCEL_GRAVITY.x + balls.impulse_x[i];
+	float accel_y = ACCEL_GRAVITY.y + balls.impulse_y[i];
+	balls.impulse_x[i] = 0;
+	balls.impulse_y[i] = 0;
+
+	float vel_x = balls.vel_x[i];
+	float vel_y = balls.vel_y[i];
+	float x = balls.pos_x[i] + (vel_x * d_time + accel_x * 0.5f * d_time * d_time);
+	float y = balls.pos_y[i] + (vel_y * d_time + accel_y * 0.5f * d_time * d_time);
+	vel_x = vel_x + accel_x * d_time;
+	vel_y = vel_y + accel_y * d_time;
+
+	// Bottom wall
+	if (y - HALF_BALL <= WALL_BOTTOM) {
+		float y_displace = WALL_BOTTOM - (y - HALF_BALL);
+		x = x + vel_x / vel_y * y_displace;
+		y = y + y_displace;
+		vel_x = vel_x * WALL_ELASTICITY;
+		vel_y = -vel_y * WALL_ELASTICITY;
+		float speed = sqrtf(vel_x * vel_x + vel_y * vel_y);
+		if (speed > 0.5f) {
+			hits.push_back({ i, fminf(fmaxf(speed - 0.5f, 0.0f), 1.0f) });
+		}
+	}
+
+	// Top wall
+	if (y + HALF_BALL >= WALL_TOP) {
+		float y_displace = WALL_TOP - (y + HALF_BALL);
+		x = x + vel_x / vel_y * y_displace;
+		y = y + y_displace;
+		vel_x = vel_x * WALL_ELASTICITY;
+		vel_y = -vel_y * WALL_ELASTICITY;
+		float speed = sqrtf(vel_x * vel_x + vel_y * vel_y);
+		if (speed > 0.5f) {
+			hits.push_back({ i, fminf(fmaxf(speed - 0.5f, 0.0f), 1.0f) });
+		}
+	}
+
+	// Side walls
+	bool left = x - HALF_BALL <= WALL_LEFT;
+	if (left || x + HALF_BALL >= WALL_RIGHT) {
+		float x_displace = left ? WALL_LEFT - (x - HALF_BALL) : WALL_RIGHT - (x + HALF_BALL);
+		y = y + vel_y / vel_x * x_displace;
+		x = x + x_displace;
+		vel_x = -vel_x * WALL_ELASTICITY;
+		vel_y = vel_y * WALL_ELASTICITY;
+		float speed = sqrtf(vel_x * vel_x + vel_y * vel_y);
+		if (speed > 0.5f) {
+			hits.push_back({ i, fminf(fmaxf(speed - 0.5f, 0.0f), 1.0f) });
+		}
+	}
+
+	balls.pos_x[i] = x;
+	balls.pos_y[i] = y;
+	balls.vel_x[i] = vel_x;
+	balls.vel_y[i] = vel_y;
+}
+
+#if KERNELS_X86
+
+// Hits for one block, kept per wall until the end so they can be written out
+// in ball order
+template<int WIDTH>
+struct BlockHits {
+	int masks[3];
+	float volumes[3][WIDTH];
+
+	void emit(int first_ball, std::vector<WallHit>& hits) const {
+		if ((masks[0] | masks[1] | masks[2]) == 0) {
+			return;
+		}
+		for (int lane = 0; lane < WIDTH; lane++) {
+			for (int wall = 0; wall < 3; wall++) {
+				if (masks[wall] & (1 << lane)) {
+					hits.push_back({ first_ball + lane, volumes[wall][lane] });
+				}
+			}
+		}
+	}
+};
+
+static inline __m128 select(__m128 mask, __m128 a, __m128 b) {
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static void integrateWallsSSE2(BallStore& balls, int begin, int end, std::vector<WallHit>& hits) {
+	const __m128 d_time     = _mm_set1_ps(PHYSICS_TIMESTEP);
+	const __m128 half       = _mm_set1_ps(0.5f);
+	const __m128 zero       = _mm_setzero_ps();
+	const __m128 one        = _mm_set1_ps(1.0f);
+	const __m128 sign       = _mm_set1_ps(-0.0f);
+	const __m128 half_ball  = _mm_set1_ps(HALF_BALL);
+	const __m128 elasticity = _mm_set1_ps(WALL_ELASTICITY);
+	const __m128 bottom     = _mm_set1_ps(WALL_BOTTOM);
+	const __m128 top        = _mm_set1_ps(WALL_TOP);
+	const __m128 left_wall  = _mm_set1_ps(WALL_LEFT);
+	const __m128 right_wall = _mm_set1_ps(WALL_RIGHT);
+
+	int i = begin;
+	for (; i + 4 <= end; i += 4) {
+		__m128 accel_x = _mm_add_ps(_mm_set1_ps(ACCEL_GRAVITY.x), _mm_loadu_ps(&balls.impulse_x[i]));
+		__m128 accel_y = _mm_add_ps(_mm_set1_ps(ACCEL_GRAVITY.y), _mm_loadu_ps(&balls.impulse_y[i]));
+		_mm_storeu_ps(&balls.impulse_x[i], zero);
+		_mm_storeu_ps(&balls.impulse_y[i], zero);
+
+		__m128 vel_x = _mm_loadu_ps(&balls.vel_x[i]);
+		__m128 vel_y = _mm_loadu_ps(&balls.vel_y[i]);
+		__m128 x = _mm_add_ps(_mm_loadu_ps(&balls.pos_x[i]), _mm_add_ps(_mm_mul_ps(vel_x, d_time),
+			_mm_mul_ps(_mm_mul_ps(_mm_mul_ps(accel_x, half), d_time), d_time)));
+		__m128 y = _mm_add_ps(_mm_loadu_ps(&balls.pos_y[i]), _mm_add_ps(_mm_mul_ps(vel_y, d_time),
+			_mm_mul_ps(_mm_mul_ps(_mm_mul_ps(accel_y, half), d_time), d_time)));
+		vel_x = _mm_add_ps(vel_x, _mm_mul_ps(accel_x, d_time));
+		vel_y = _mm_add_ps(vel_y, _mm_mul_ps(accel_y, d_time));
+
+		BlockHits<4> block;
+		__m128 speed, heard;
+
+		// Bottom wall
+		__m128 hit = _mm_cmple_ps(_mm_sub_ps(y, half_ball), bottom);
+		__m128 y_displace = _mm_sub_ps(bottom, _mm_sub_ps(y, half_ball));
+		x = select(hit, _mm_add_ps(x, _mm_mul_ps(_mm_div_ps(vel_x, vel_y), y_displace)), x);
+		y = select(hit, _mm_add_ps(y, y_displace), y);
+		vel_x = select(hit, _mm_mul_ps(vel_x, elasticity), vel_x);
+		vel_y = select(hit, _mm_mul_ps(_mm_xor_ps(vel_y, sign), elasticity), vel_y);
+		speed = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vel_x, vel_x), _mm_mul_ps(vel_y, vel_y)));
+		heard = _mm_and_ps(hit, _mm_cmpgt_ps(speed, half));
+		block.masks[0] = _mm_movemask_ps(heard);
+		_mm_storeu_ps(block.volumes[0], _mm_min_ps(_mm_max_ps(_mm_sub_ps(speed, half), zero), one));
+
+		// Top wall
+		hit = _mm_cmpge_ps(_mm_add_ps(y, half_ball), top);
+		y_displace = _mm_sub_ps(top, _mm_add_ps(y, half_ball));
+		x = select(hit, _mm_add_ps(x, _mm_mul_ps(_mm_div_ps(vel_x, vel_y), y_displace)), x);
+		y = select(hit, _mm_add_ps(y, y_displace), y);
+		vel_x = select(hit, _mm_mul_ps(vel_x, elasticity), vel_x);
+		vel_y = select(hit, _mm_mul_ps(_mm_xor_ps(vel_y, sign), elasticity), vel_y);
+		speed = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vel_x, vel_x), _mm_mul_ps(vel_y, vel_y)));
+		heard = _mm_and_ps(hit, _mm_cmpgt_ps(speed, half));
+		block.masks[1] = _mm_movemask_ps(heard);
+		_mm_storeu_ps(block.volumes[1], _mm_min_ps(_mm_max_ps(_mm_sub_ps(speed, half), zero), one));
+
+		// Side walls
+		__m128 left = _mm_cmple_ps(_mm_sub_ps(x, half_ball), left_wall);
+		hit = _mm_or_ps(left, _mm_cmpge_ps(_mm_add_ps(x, half_ball), right_wall));
+		__m128 x_displace = select(left,
+			_mm_sub_ps(left_wall, _mm_sub_ps(x, half_ball)),
+			_mm_sub_ps(right_wall, _mm_add_ps(x, half_ball)));
+		y = select(hit, _mm_add_ps(y, _mm_mul_ps(_mm_div_ps(vel_y, vel_x), x_displace)), y);
+		x = select(hit, _mm_add_ps(x, x_displace), x);
+		vel_x = select(hit, _mm_mul_ps(_mm_xor_ps(vel_x, sign), elasticity), vel_x);
+		vel_y = select(hit, _mm_mul_ps(vel_y, elasticity), vel_y);
+		speed = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vel_x, vel_x), _mm_mul_ps(vel_y, vel_y)));
+		heard = _mm_and_ps(hit, _mm_cmpgt_ps(speed, half));
+		block.masks[2] = _mm_movemask_ps(heard);
+		_mm_storeu_ps(block.volumes[2], _mm_min_ps(_mm_max_ps(_mm_sub_ps(speed, half), zero), one));
+
+		_mm_storeu_ps(&balls.pos_x[i], x);
+		_mm_storeu_ps(&balls.pos_y[i], y);
+		_mm_storeu_ps(&balls.vel_x[i], vel_x);
+		_mm_storeu_ps(&balls.vel_y[i], vel_y);
+		block.emit(i, hits);
+	}
+	for (; i < end; i++) {
+		integrateWallsScalar(balls, i, hits);
+	}
+}
+
+KERNEL_TARGET_AVX2
+static void integrateWallsAVX2(BallStore& balls, int begin, int end, std::vector<WallHit>& hits) {
+	const __m256 d_time     = _mm256_set1_ps(PHYSICS_TIMESTEP);
+	const __m256 half       = _mm256_set1_ps(0.5f);
+	const __m256 zero       = _mm256_setzero_ps();
+	const __m256 one        = _mm256_set1_ps(1.0f);
+	const __m256 sign       = _mm256_set1_ps(-0.0f);
+	const __m256 half_ball  = _mm256_set1_ps(HALF_BALL);
+	const __m256 elasticity = _mm256_set1_ps(WALL_ELASTICITY);
+	const __m256 bottom     = _mm256_set1_ps(WALL_BOTTOM);
+	const __m256 top        = _mm256_set1_ps(WALL_TOP);
+	const __m256 left_wall  = _mm256_set1_ps(WALL_LEFT);
+	const __m256 right_wall = _mm256_set1_ps(WALL_RIGHT);
+
+	int i = begin;
+	for (; i + 8 <= end; i += 8) {
+		__m256 accel_x = _mm256_add_ps(_mm256_set1_ps(ACCEL_GRAVITY.x), _mm256_loadu_ps(&balls.impulse_x[i]));
+		__m256 accel_y = _mm256_add_ps(_mm256_set1_ps(ACCEL_GRAVITY.y), _mm256_loadu_ps(&balls.impulse_y[i]));
+		_mm256_storeu_ps(&balls.impulse_x[i], zero);
+		_mm256_storeu_ps(&balls.impulse_y[i], zero);
+
+		__m256 vel_x = _mm256_loadu_ps(&balls.vel_x[i]);
+		__m256 vel_y = _mm256_loadu_ps(&balls.vel_y[i]);
+		__m256 x = _mm256_add_ps(_mm256_loadu_ps(&balls.pos_x[i]), _mm256_add_ps(_mm256_mul_ps(vel_x, d_time),
+			_mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(accel_x, half), d_time), d_time)));
+		__m256 y = _mm256_add_ps(_mm256_loadu_ps(&balls.pos_y[i]), _mm256_add_ps(_mm256_mul_ps(vel_y, d_time),
+			_mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(accel_y, half), d_time), d_time)));
+		vel_x = _mm256_add_ps(vel_x, _mm256_mul_ps(accel_x, d_time));
+		vel_y = _mm256_add_ps(vel_y, _mm256_mul_ps(accel_y, d_time));
+
+		BlockHits<8> block;
+		__m256 speed, heard;
+
+		// Bottom wall
+		__m256 hit = _mm256_cmp_ps(_mm256_sub_ps(y, half_ball), bottom, _CMP_LE_OQ);
+		__m256 y_displace = _mm256_sub_ps(bottom, _mm256_sub_ps(y, half_ball));
+		x = _mm256_blendv_ps(x, _mm256_add_ps(x, _mm256_mul_ps(_mm256_div_ps(vel_x, vel_y), y_displace)), hit);
+		y = _mm256_blendv_ps(y, _mm256_add_ps(y, y_displace), hit);
+		vel_x = _mm256_blendv_ps(vel_x, _mm256_mul_ps(vel_x, elasticity), hit);
+		vel_y = _mm256_blendv_ps(vel_y, _mm256_mul_ps(_mm256_xor_ps(vel_y, sign), elasticity), hit);
+		speed = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(vel_x, vel_x), _mm256_mul_ps(vel_y, vel_y)));
+		heard = _mm256_and_ps(hit, _mm256_cmp_ps(speed, half, _CMP_GT_OQ));
+		block.masks[0] = _mm256_movemask_ps(heard);
+		_mm256_storeu_ps(block.volumes[0], _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(speed, half), zero), one));
+
+		// Top wall
+		hit = _mm256_cmp_ps(_mm256_add_ps(y, half_ball), top, _CMP_GE_OQ);
+		y_displace = _mm256_sub_ps(top, _mm256_add_ps(y, half_ball));
+		x = _mm256_blendv_ps(x, _mm256_add_ps(x, _mm256_mul_ps(_mm256_div_ps(vel_x, vel_y), y_displace)), hit);
+		y = _mm256_blendv_ps(y, _mm256_add_ps(y, y_displace), hit);
+		vel_x = _mm256_blendv_ps(vel_x, _mm256_mul_ps(vel_x, elasticity), hit);
+		vel_y = _mm256_blendv_ps(vel_y, _mm256_mul_ps(_mm256_xor_ps(vel_y, sign), elasticity), hit);
+		speed = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(vel_x, vel_x), _mm256_mul_ps(vel_y, vel_y)));
+		heard = _mm256_and_ps(hit, _mm256_cmp_ps(speed, half, _CMP_GT_OQ));
+		block.masks[1] = _mm256_movemask_ps(heard);
+		_mm256_storeu_ps(block.volumes[1], _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(speed, half), zero), one));
+
+		// Side walls
+		__m256 left = _mm256_cmp_ps(_mm256_sub_ps(x, half_ball), left_wall, _CMP_LE_OQ);
+		hit = _mm256_or_ps(left, _mm256_cmp_ps(_mm256_add_ps(x, half_ball), right_wall, _CMP_GE_OQ));
+		__m256 x_displace = _mm256_blendv_ps(
+			_mm256_sub_ps(right_wall, _mm256_add_ps(x, half_ball)),
+			_mm256_sub_ps(left_wall, _mm256_sub_ps(x, half_ball)), left);
+		y = _mm256_blendv_ps(y, _mm256_add_ps(y, _mm256_mul_ps(_mm256_div_ps(vel_y, vel_x), x_displace)), hit);
+		x = _mm256_blendv_ps(x, _mm256_add_ps(x, x_displace), hit);
+		vel_x = _mm256_blendv_ps(vel_x, _mm256_mul_ps(_mm256_xor_ps(vel_x, sign), elasticity), hit);
+		vel_y = _mm256_blendv_ps(vel_y, _mm256_mul_ps(vel_y, elasticity), hit);
+		speed = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(vel_x, vel_x), _mm256_mul_ps(vel_y, vel_y)));
+		heard = _mm256_and_ps(hit, _mm256_cmp_ps(speed, half, _CMP_GT_OQ));
+		block.masks[2] = _mm256_movemask_ps(heard);
+		_mm256_storeu_ps(block.volumes[2], _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(speed, half), zero), one));
+
+		_mm256_storeu_ps(&balls.pos_x[i], x);
+		_mm256_storeu_ps(&balls.pos_y[i], y);
+		_mm256_storeu_ps(&balls.vel_x[i], vel_x);
+		_mm256_storeu_ps(&balls.vel_y[i], vel_y);
+		block.emit(i, hits);
+	}
+	for (; i < end; i++) {
+		integrateWallsScalar(balls, i, hits);
+	}
+}
+
+#endif
+
+void integrateAndCollideWalls(KernelLevel level, BallStore& balls, int begin, int end, std::vector<WallHit>& hits) {
+#if KERNELS_X86
+	if (level == KERNEL_AVX2) {
+		integrateWallsAVX2(balls, begin, end, hits);
+		return;
+	}
+	if (level == KERNEL_SSE2) {
+		integrateWallsSSE2(balls, begin, end, hits);
+		return;
+	}
+#endif
+	for (int i = begin; i < end; i++) {
+		integrateWallsScalar(balls, i, hits);
+	}
+}
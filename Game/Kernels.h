@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+struct BallStore;
+
+// Vectorised integration and wall kernels. Each does the same thing as
+// BallStore::tickGravity() followed by BallStore::collideWalls(), but for a run
+// of balls at once, using lane masks instead of branches. The widest one the
+// CPU supports is picked at startup.
+
+enum KernelLevel {
+	KERNEL_SCALAR,
+	KERNEL_SSE2,
+	KERNEL_AVX2
+};
+
+KernelLevel detectKernelLevel();
+const char* kernelLevelName(KernelLevel level);
+
+// A ball that hit a wall hard enough to be heard
+struct WallHit {
+	int ball;
+	float volume;
+};
+
+// Integrates gravity and explosion impulses, then resolves the four walls,
+// for balls [begin, end). Hits come out in ball order, and within a ball in
+// the same bottom/top/sides order as collideWalls().
+void integrateAndCollideWalls(KernelLevel level, BallStore& balls, int begin, int end, std::vector<WallHit>& hits);
@@ -0,0 +1,104 @@
+#pragma once
+
+// Everything that differs between kinds of ball. Adding one is a MatterType
+// before MATTER_COUNT, its row in MATTER_INFO, and a MATTER_RULES entry for
+// every pair that doesn't behave like DEFAULT_INTERACTION. The rules are
+// folded into MATTER_TABLE at compile time, so the physics looks a pair up
+// with one load however many kinds there are.
+
+enum MatterType {
+	WHITE_MATTER,
+	RED_MATTER,
+	BLUE_MATTER,
+	MATTER_COUNT
+};
+
+struct MatterInfo {
+	const char* name;
+	// RGBA
+	float color[4];
+	// Odds of being dropped next while there are too few balls in play to
+	// balance against
+	int first_chance_points;
+	// SpawnTuning's defaults
+	int base_chance_points;
+	float expected_proportion;
+};
+
+static constexpr MatterInfo MATTER_INFO[MATTER_COUNT] = {
+	{ "white", { 1.0f, 1.0f, 1.0f, 1.0f }, 33, 20, 0.20f },
+	{ "red",   { 1.0f, 0.0f, 0.0f, 1.0f }, 33, 40, 0.40f },
+	{ "blue",  { 0.0f, 0.0f, 1.0f, 1.0f }, 34, 40, 0.40f },
+};
+
+// A short MATTER_INFO leaves the last rows zeroed rather than failing
+static_assert(MATTER_INFO[MATTER_COUNT - 1].name != nullptr, "every matter type needs a MATTER_INFO row");
+
+// What happens when two balls touch
+struct MatterInteraction {
+	// Both go up, leaving an explosion each
+	bool annihilate;
+	// Force constant pushing them apart
+	float repel;
+	// Scales what's kept of their velocities after the knock
+	float elasticity;
+	// Even a dead head-on hit keeps this much of its speed. Stopped dead, a
+	// ball has no direction, its next contact counts as side-on and the pile
+	// never settles. libm got this by accident from PI rounding up in float.
+	float min_energy_kept;
+};
+
+static constexpr MatterInteraction DEFAULT_INTERACTION = { false, 0.5f, 1.0f, 1.7e-4f };
+
+// Applies both ways round
+struct MatterRule {
+	MatterType a, b;
+	MatterInteraction interaction;
+};
+
+static constexpr MatterRule MATTER_RULES[] = {
+	{ RED_MATTER, BLUE_MATTER, { true, 0.5f, 1.0f, 1.7e-4f } },
+};
+
+struct MatterTable {
+	MatterInteraction pairs[MATTER_COUNT][MATTER_COUNT];
+
+	constexpr const MatterInteraction& operator()(MatterType a, MatterType b) const {
+		return pairs[a][b];
+	}
+};
+
+constexpr MatterTable buildMatterTable() {
+	MatterTable table = {};
+	for (int a = 0; a < MATTER_COUNT; a++) {
+		for (int b = 0; b < MATTER_COUNT; b++) {
+			table.pairs[a][b] = DEFAULT_INTERACTION;
+		}
+	}
+	for (const MatterRule& rule : MATTER_RULES) {
+		table.pairs[rule.a][rule.b] = rule.interaction;
+		table.pairs[rule.b][rule.a] = rule.interaction;
+	}
+	return table;
+}
+
+static constexpr MatterTable MATTER_TABLE = buildMatterTable();
+
+// A second rule for the same pair would quietly win over the first
+constexpr bool matterRulesUnique() {
+	int count = sizeof(MATTER_RULES) / sizeof(MatterRule);
+	for (int i = 0; i < count; i++) {
+		for (int j = i + 1; j < count; j++) {
+			const MatterRule& x = MATTER_RULES[i];
+			const MatterRule& y = MATTER_RULES[j];
+			if ((x.a == y.a && x.b == y.b) || (x.a == y.b && x.b == y.a)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static_assert(matterRulesUnique(), "two MATTER_RULES for the same pair");
+static_assert(MATTER_TABLE(RED_MATTER, BLUE_MATTER).annihilate, "red and blue annihilate");
+static_assert(!MATTER_TABLE(WHITE_MATTER, RED_MATTER).annihilate && !MATTER_TABLE(RED_MATTER, RED_MATTER).annihilate, "nothing else does");
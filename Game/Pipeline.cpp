@@ -0,0 +1,115 @@
+#include "Pipeline.h"
+#include "Profiler.h"
+
+#include <chrono>
+
+SimPipeline::SimPipeline(Simulation& sim, Recording& recording, bool threaded)
+	: sim(sim), recording(recording), threaded(threaded) {
+	if (threaded) {
+		thread = std::thread(&SimPipeline::threadMain, this);
+	}
+}
+
+SimPipeline::~SimPipeline() {
+	if (threaded) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quitting = true;
+		}
+		wake.notify_one();
+		thread.join();
+	}
+}
+
+void SimPipeline::post(const SimCommand& command) {
+	std::lock_guard<std::mutex> lock(command_mutex);
+	commands.push_back(command);
+}
+
+void SimPipeline::start(int steps, float alpha) {
+	if (!threaded) {
+		runBatch(steps, alpha);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		batch_steps = steps;
+		batch_alpha = alpha;
+		busy = true;
+	}
+	wake.notify_one();
+}
+
+void SimPipeline::finish() {
+	if (threaded) {
+		PROFILE_SCOPE("wait for physics");
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [&] { return !busy; });
+	}
+	front_index ^= 1;
+}
+
+void SimPipeline::threadMain() {
+	while (true) {
+		int steps;
+		float alpha;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return quitting || busy; });
+			if (quitting) {
+				return;
+			}
+			steps = batch_steps;
+			alpha = batch_alpha;
+		}
+		runBatch(steps, alpha);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			busy = false;
+		}
+		done.notify_one();
+	}
+}
+
+void SimPipeline::runBatch(int steps, float alpha) {
+	PROFILE_SCOPE("physics batch");
+	auto start = std::chrono::steady_clock::now();
+	SimSnapshot& back = snapshots[front_index ^ 1];
+
+	{
+		std::lock_guard<std::mutex> lock(command_mutex);
+		applying.swap(commands);
+	}
+	for (const auto& command : applying) {
+		if (command.type == SIM_CLICK) {
+			SpawnCommand spawn;
+			spawn.matter = next_ball;
+			spawn.pos = command.pos;
+			recording.spawn(sim.stepCount(), spawn);
+			sim.spawn(spawn);
+			next_ball = sim.whichBallNext();
+		} else {
+			recording.reset(sim.stepCount());
+			sim.reset();
+			next_ball = WHITE_MATTER;
+			resets++;
+		}
+	}
+	applying.clear();
+
+	back.sounds.clear();
+	for (int i = 0; i < steps; i++) {
+		sim.step();
+		back.sounds.insert(back.sounds.end(), sim.sounds.begin(), sim.sounds.end());
+	}
+
+	back.instances.build(sim.balls, alpha);
+	back.layout_version = sim.layout_version;
+	back.steps = steps;
+	back.score = sim.score();
+	back.awake_count = sim.awake_count;
+	back.asleep_count = sim.asleep_count;
+	back.next_ball = next_ball;
+	back.resets = resets;
+	back.physics_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "BallInstances.h"
+#include "Recording.h"
+#include "Simulation.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs a frame's physics steps on a thread of its own while the main thread
+// draws what the steps before them left behind. A frame goes
+//
+//   start(steps, alpha)   the worker applies queued input and steps
+//   ...draw front()...    the last batch's snapshot
+//   finish()              wait for the worker, its snapshot becomes front()
+//
+// so a frame takes about the longer of the two instead of both, and what's
+// drawn is a frame behind. Between finish() and the next start() the worker
+// is idle, and the simulation and recording are safe to touch again.
+
+// Everything drawing and the HUD need from a batch of steps
+struct SimSnapshot {
+	// Already `alpha` of the way between the last two steps
+	BallInstanceBuffer instances;
+	// Simulation::layout_version as of the snapshot
+	uint32_t layout_version = 0;
+	// Everything raised over the batch, to go to the SoundQueue
+	std::vector<SoundEvent> sounds;
+	int steps = 0;
+	int score = 0;
+	int awake_count = 0;
+	int asleep_count = 0;
+	// The ball the next click drops
+	MatterType next_ball = WHITE_MATTER;
+	// Bumped by every reset applied so far
+	uint32_t resets = 0;
+	// How long the batch took, input included
+	float physics_ms = 0;
+};
+
+enum SimCommandType {
+	// Drop the next ball at `pos`, then pick the one after
+	SIM_CLICK,
+	SIM_RESET
+};
+
+struct SimCommand {
+	SimCommandType type;
+	Vec2 pos;
+};
+
+class SimPipeline {
+	Simulation& sim;
+	Recording& recording;
+	bool threaded;
+
+	SimSnapshot snapshots[2];
+	int front_index = 0;
+	MatterType next_ball = WHITE_MATTER;
+	uint32_t resets = 0;
+
+	std::mutex command_mutex;
+	std::vector<SimCommand> commands;
+	// Swapped with `commands` at the start of a batch, so posting never waits
+	// on the batch
+	std::vector<SimCommand> applying;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	bool busy = false;
+	bool quitting = false;
+	int batch_steps = 0;
+	float batch_alpha = 0;
+
+	void threadMain();
+	// Into the back snapshot
+	void runBatch(int steps, float alpha);
+
+public:
+	// Unthreaded, start() runs the batch itself and finish() only swaps, for
+	// comparing against or on one core
+	SimPipeline(Simulation& sim, Recording& recording, bool threaded);
+	SimPipeline(const SimPipeline&) = delete;
+	SimPipeline& operator=(const SimPipeline&) = delete;
+	~SimPipeline();
+
+	// Any thread, any time. Applied, and recorded, before the next batch's
+	// first step.
+	void post(const SimCommand& command);
+	void start(int steps, float alpha);
+	void finish();
+
+	const SimSnapshot& front() const {
+		return snapshots[front_index];
+	}
+};
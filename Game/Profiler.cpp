@@ -0,0 +1,124 @@
+#include "Profiler.h"
+
+#if PROFILING
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+namespace Profiler {
+
+// `sequence` is the ring position plus one once the slot is fully written, so
+// a reader can tell a finished event from a half-written or stale one
+struct Slot {
+	std::atomic<uint64_t> sequence;
+	Event event;
+};
+
+static Slot ring[PROFILE_CAPACITY];
+static std::atomic<uint64_t> head(0);
+static std::atomic<uint32_t> next_thread(0);
+static const auto epoch = std::chrono::steady_clock::now();
+std::atomic<bool> enabled_flag(true);
+
+static uint32_t threadIndex() {
+	thread_local uint32_t index = next_thread.fetch_add(1);
+	return index;
+}
+
+int64_t now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void setEnabled(bool on) {
+	enabled_flag.store(on, std::memory_order_relaxed);
+}
+
+void record(const char* name, int64_t begin_ns, int64_t end_ns) {
+	if (!enabled()) {
+		return;
+	}
+	uint64_t position = head.fetch_add(1, std::memory_order_relaxed);
+	Slot& slot = ring[position % PROFILE_CAPACITY];
+	slot.sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.event.name = name;
+	slot.event.thread = threadIndex();
+	slot.event.begin_ns = begin_ns;
+	slot.event.end_ns = end_ns;
+	slot.sequence.store(position + 1, std::memory_order_release);
+}
+
+int snapshot(Event* out, int max_events) {
+	uint64_t end = head.load(std::memory_order_acquire);
+	uint64_t count = std::min<uint64_t>({ end, (uint64_t)PROFILE_CAPACITY, (uint64_t)max_events });
+	int written = 0;
+	for (uint64_t position = end - count; position < end; position++) {
+		Slot& slot = ring[position % PROFILE_CAPACITY];
+		if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+			continue;
+		}
+		Event event = slot.event;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		// Overwritten while we were copying it
+		if (slot.sequence.load(std::memory_order_relaxed) != position + 1) {
+			continue;
+		}
+		out[written++] = event;
+	}
+	return written;
+}
+
+bool writeTrace(const char* path) {
+	std::vector<Event> events(PROFILE_CAPACITY);
+	events.resize(snapshot(events.data(), PROFILE_CAPACITY));
+
+	FILE* file = fopen(path, "w");
+	if (!file) {
+		return false;
+	}
+	// Complete ("X") events; Chrome wants microseconds
+	fprintf(file, "{\"traceEvents\":[\n");
+	for (size_t i = 0; i < events.size(); i++) {
+		const auto& event = events[i];
+		fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+			event.name, event.thread, event.begin_ns / 1000.0, (event.end_ns - event.begin_ns) / 1000.0,
+			i + 1 < events.size() ? "," : "");
+	}
+	fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+	fclose(file);
+	return true;
+}
+
+void printSummary(FILE* out) {
+	std::vector<Event> events(PROFILE_CAPACITY);
+	events.resize(snapshot(events.data(), PROFILE_CAPACITY));
+
+	// Group by name, in the order each phase first shows up
+	std::vector<const char*> names;
+	std::vector<std::vector<int64_t>> durations;
+	for (const auto& event : events) {
+		size_t n = 0;
+		while (n < names.size() && strcmp(names[n], event.name) != 0) {
+			n++;
+		}
+		if (n == names.size()) {
+			names.push_back(event.name);
+			durations.emplace_back();
+		}
+		durations[n].push_back(event.end_ns - event.begin_ns);
+	}
+
+	fprintf(out, "%-20s %8s %10s %10s %10s\n", "phase", "count", "p50 us", "p99 us", "max us");
+	for (size_t n = 0; n < names.size(); n++) {
+		auto& times = durations[n];
+		std::sort(times.begin(), times.end());
+		fprintf(out, "%-20s %8d %10.1f %10.1f %10.1f\n", names[n], (int)times.size(),
+			times[times.size() / 2] / 1000.0, times[times.size() * 99 / 100] / 1000.0, times.back() / 1000.0);
+	}
+}
+
+}
+
+#endif
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+// Scoped phase timers. PROFILE_SCOPE("name") times the rest of the enclosing
+// block into a fixed ring of the last PROFILE_CAPACITY events, which can be
+// dumped as a Chrome trace (chrome://tracing, or ui.perfetto.dev) or summed
+// up per phase. Build with -DPROFILING=0 and every macro turns into nothing;
+// PROFILE_SET_ENABLED(false) stops recording at runtime, for things like
+// `headless batch` where every core would otherwise fight over the ring.
+#ifndef PROFILING
+#define PROFILING 1
+#endif
+
+namespace Profiler {
+
+static const int PROFILE_CAPACITY = 1 << 16;
+
+// Names have to be string literals; only the pointer is kept
+struct Event {
+	const char* name;
+	uint32_t thread;
+	int64_t begin_ns;
+	int64_t end_ns;
+};
+
+#if PROFILING
+
+// Only ever read on the hot path, so it never bounces between cores
+extern std::atomic<bool> enabled_flag;
+
+inline bool enabled() {
+	return enabled_flag.load(std::memory_order_relaxed);
+}
+// Scopes already open when it's turned off still record when they close
+void setEnabled(bool on);
+
+// Lock-free, any thread. Old events get overwritten once the ring wraps.
+// Does nothing while disabled.
+void record(const char* name, int64_t begin_ns, int64_t end_ns);
+int64_t now();
+
+// Copies out whatever's in the ring, oldest first. Events still being
+// written by another thread are skipped rather than waited on.
+int snapshot(Event* out, int max_events);
+
+// Writes the ring as Chrome trace JSON. False if the file couldn't be opened.
+bool writeTrace(const char* path);
+// p50/p99/max per phase over everything in the ring
+void printSummary(FILE* out);
+
+struct Scope {
+	const char* name;
+	int64_t begin_ns;
+	bool active;
+	Scope(const char* name) : name(name), begin_ns(0), active(enabled()) {
+		if (active) {
+			begin_ns = now();
+		}
+	}
+	~Scope() {
+		if (active) {
+			record(name, begin_ns, now());
+		}
+	}
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) Profiler::Scope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+// A zero-length event, for marking when something changed
+#define PROFILE_MARK(name) Profiler::record(name, Profiler::now(), Profiler::now())
+#define PROFILE_WRITE_TRACE(path) Profiler::writeTrace(path)
+#define PROFILE_PRINT_SUMMARY(out) Profiler::printSummary(out)
+#define PROFILE_ENABLED() Profiler::enabled()
+#define PROFILE_SET_ENABLED(on) Profiler::setEnabled(on)
+
+#else
+
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_MARK(name) ((void)0)
+#define PROFILE_WRITE_TRACE(path) false
+#define PROFILE_PRINT_SUMMARY(out) ((void)0)
+#define PROFILE_ENABLED() false
+#define PROFILE_SET_ENABLED(on) ((void)(on))
+
+#endif
+
+}
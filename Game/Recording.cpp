@@ -0,0 +1,175 @@
+#include "Recording.h"
+
+#include <cstdio>
+#include <cstring>
+
+static const char RECORDING_MAGIC[4] = { 'N', 'C', 'R', 'C' };
+static const uint16_t RECORDING_VERSION = 2;
+
+// Saved as a byte each
+static_assert(MATTER_COUNT <= 256, "too many matter types for the recording format");
+
+void Recording::remember(const Simulation& sim) {
+	explosion = sim.explosion;
+	allow_sleep = sim.allow_sleep;
+	doze_settled = sim.doze_settled;
+}
+
+void Recording::spawn(uint32_t step, const SpawnCommand& command) {
+	events.push_back({ step, EVENT_SPAWN, command.matter, command.pos, SHED_NONE });
+}
+
+void Recording::reset(uint32_t step) {
+	events.push_back({ step, EVENT_RESET, WHITE_MATTER, Vec2(0, 0), SHED_NONE });
+}
+
+void Recording::shed(uint32_t step, ShedLevel level) {
+	events.push_back({ step, EVENT_SHED, WHITE_MATTER, Vec2(0, 0), level });
+}
+
+// Byte at a time, so the file reads the same on any machine
+static void put(std::vector<uint8_t>& out, uint32_t value, int bytes) {
+	for (int i = 0; i < bytes; i++) {
+		out.push_back((uint8_t)(value >> (8 * i)));
+	}
+}
+
+static uint32_t get(const uint8_t*& in, int bytes) {
+	uint32_t value = 0;
+	for (int i = 0; i < bytes; i++) {
+		value |= (uint32_t)*in++ << (8 * i);
+	}
+	return value;
+}
+
+static uint32_t floatBits(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static float bitsFloat(uint32_t bits) {
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+bool Recording::save(const char* path) const {
+	std::vector<uint8_t> data;
+	data.insert(data.end(), RECORDING_MAGIC, RECORDING_MAGIC + 4);
+	put(data, RECORDING_VERSION, 2);
+	put(data, seed, 4);
+	put(data, steps, 4);
+	put(data, (uint32_t)events.size(), 4);
+	put(data, explosion.mode, 1);
+	put(data, floatBits(explosion.radius), 4);
+	put(data, floatBits(explosion.fade), 4);
+	put(data, (uint32_t)explosion.field_dim, 4);
+	put(data, (allow_sleep ? 1 : 0) | (doze_settled ? 2 : 0), 1);
+	for (const auto& event : events) {
+		put(data, event.step, 4);
+		put(data, event.type, 1);
+		// Whichever of the two the event has
+		put(data, event.type == EVENT_SHED ? (uint32_t)event.level : (uint32_t)event.matter, 1);
+		put(data, floatBits(event.pos.x), 4);
+		put(data, floatBits(event.pos.y), 4);
+	}
+
+	FILE* file = fopen(path, "wb");
+	if (!file) {
+		return false;
+	}
+	bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+	return fclose(file) == 0 && ok;
+}
+
+bool Recording::load(const char* path) {
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		return false;
+	}
+	std::vector<uint8_t> data;
+	uint8_t buffer[4096];
+	size_t got;
+	while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		data.insert(data.end(), buffer, buffer + got);
+	}
+	fclose(file);
+
+	const size_t VERSION_1_HEADER_SIZE = 18;
+	const size_t HEADER_SIZE = 32;
+	const size_t EVENT_SIZE = 14;
+	if (data.size() < VERSION_1_HEADER_SIZE || memcmp(data.data(), RECORDING_MAGIC, 4) != 0) {
+		return false;
+	}
+	const uint8_t* in = data.data() + 4;
+	uint32_t version = get(in, 2);
+	if (version != 1 && version != RECORDING_VERSION) {
+		return false;
+	}
+	size_t header_size = version == 1 ? VERSION_1_HEADER_SIZE : HEADER_SIZE;
+	if (data.size() < header_size) {
+		return false;
+	}
+	seed = get(in, 4);
+	steps = get(in, 4);
+	uint32_t count = get(in, 4);
+	if (data.size() != header_size + count * EVENT_SIZE) {
+		return false;
+	}
+	explosion = ExplosionSettings();
+	allow_sleep = true;
+	doze_settled = false;
+	if (version > 1) {
+		uint32_t mode = get(in, 1);
+		explosion.radius = bitsFloat(get(in, 4));
+		explosion.fade = bitsFloat(get(in, 4));
+		explosion.field_dim = (int)get(in, 4);
+		uint32_t flags = get(in, 1);
+		if (mode > EXPLOSION_FIELD || explosion.field_dim < 1) {
+			return false;
+		}
+		explosion.mode = (ExplosionMode)mode;
+		allow_sleep = flags & 1;
+		doze_settled = flags & 2;
+	}
+
+	events.resize(count);
+	for (auto& event : events) {
+		event.step = get(in, 4);
+		event.type = (RecordedEventType)get(in, 1);
+		uint32_t value = get(in, 1);
+		event.pos.x = bitsFloat(get(in, 4));
+		event.pos.y = bitsFloat(get(in, 4));
+		if (event.type > EVENT_SHED || value >= (event.type == EVENT_SHED ? (uint32_t)SHED_LEVEL_COUNT : (uint32_t)MATTER_COUNT)) {
+			return false;
+		}
+		event.matter = event.type == EVENT_SHED ? WHITE_MATTER : (MatterType)value;
+		event.level = event.type == EVENT_SHED ? (ShedLevel)value : SHED_NONE;
+	}
+	return true;
+}
+
+Replay::Replay(const Recording& recording, Simulation& sim) : recording(recording), sim(sim) {
+	sim.explosion = recording.explosion;
+	sim.allow_sleep = recording.allow_sleep;
+	sim.doze_settled = recording.doze_settled;
+}
+
+void Replay::advance() {
+	const auto& events = recording.events;
+	for (; next_event < events.size() && events[next_event].step <= step; next_event++) {
+		const auto& event = events[next_event];
+		if (event.type == EVENT_SPAWN) {
+			sim.spawn({ event.matter, event.pos });
+			// Keeps the random sequence where the game had it
+			sim.whichBallNext();
+		} else if (event.type == EVENT_RESET) {
+			sim.reset();
+		} else {
+			shedSimulation(event.level, recording.explosion, sim);
+		}
+	}
+	sim.step();
+	step++;
+}
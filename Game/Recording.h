@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Governor.h"
+#include "Simulation.h"
+
+#include <cstdint>
+#include <vector>
+
+// Everything a session fed into the simulation, so it can be played back
+// step for step. Times are in physics steps rather than seconds, since the
+// step is fixed and frames aren't.
+
+enum RecordedEventType : uint8_t {
+	// A click: spawn a ball, then pick the next one
+	EVENT_SPAWN,
+	// The R key
+	EVENT_RESET,
+	// The governor changed its shed level
+	EVENT_SHED
+};
+
+struct RecordedEvent {
+	// Applied just before this step runs
+	uint32_t step;
+	RecordedEventType type;
+	// EVENT_SPAWN only
+	MatterType matter;
+	Vec2 pos;
+	// EVENT_SHED only
+	ShedLevel level;
+};
+
+struct Recording {
+	uint32_t seed = 0;
+	// How many steps the session ran for in all
+	uint32_t steps = 0;
+	// What the simulation was set up with. EVENT_SHED changes it from there
+	// the way the governor did.
+	ExplosionSettings explosion;
+	bool allow_sleep = true;
+	bool doze_settled = false;
+	std::vector<RecordedEvent> events;
+
+	// Takes the settings above from `sim`, before the session starts
+	void remember(const Simulation& sim);
+	void spawn(uint32_t step, const SpawnCommand& command);
+	void reset(uint32_t step);
+	void shed(uint32_t step, ShedLevel level);
+
+	// Little-endian, 32 byte header then 14 bytes an event. False on any
+	// I/O error or a file that isn't a recording. Version 1 files, from
+	// before the settings were saved, load with the defaults.
+	bool save(const char* path) const;
+	bool load(const char* path);
+};
+
+// Feeds a recording into a simulation one step at a time
+struct Replay {
+	const Recording& recording;
+	Simulation& sim;
+	size_t next_event = 0;
+	uint32_t step = 0;
+
+	// `sim` should be freshly made with recording.seed; this sets it up the
+	// way the session was
+	Replay(const Recording& recording, Simulation& sim);
+
+	bool done() const {
+		return step >= recording.steps;
+	}
+	// Applies this step's events and runs it
+	void advance();
+};
@@ -0,0 +1,1114 @@
+#include "Simulation.h"
+#include "FastMath.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+float SqrMagnitude(Vec2 vec) {
+	return vec.x * vec.x + vec.y * vec.y;
+}
+
+float Magnitude(Vec2 vec) {
+	return sqrt(vec.x * vec.x + vec.y * vec.y);
+}
+
+float Dot(Vec2 a, Vec2 b) {
+	return a.x * b.x + a.y * b.y;
+}
+
+Vec2 Norm(Vec2 vec) {
+	if (vec.x == 0 && vec.y == 0) {
+		return Vec2(0, 0);
+	}
+	return vec / Magnitude(vec);
+}
+
+Vec2 Normalize(Vec2 vec) {
+	return vec / Magnitude(vec);
+}
+
+Vec2 SafeNorm(Vec2 vec) {
+	float inverse = fastRsqrt(SqrMagnitude(vec));
+	if (inverse == 0) {
+		return Vec2(0, 0);
+	}
+	return vec * inverse;
+}
+
+static float soundVolume(Vec2 velocity) {
+	return fmin(fmax(0.0f, fastSqrt(SqrMagnitude(velocity)) - 0.5f), 1.0f);
+}
+
+//
+// BallStore
+//
+
+BallHandle BallStore::add(MatterType type, Vec2 pos, Vec2 velocity, float ball_mass) {
+	uint32_t slot;
+	if (!free_slots.empty()) {
+		slot = free_slots.back();
+		free_slots.pop_back();
+	} else {
+		slot = (uint32_t)slot_index.size();
+		slot_index.push_back(-1);
+		slot_generation.push_back(0);
+	}
+	slot_index[slot] = size();
+
+	pos_x.push_back(pos.x);
+	pos_y.push_back(pos.y);
+	prev_x.push_back(pos.x);
+	prev_y.push_back(pos.y);
+	vel_x.push_back(velocity.x);
+	vel_y.push_back(velocity.y);
+	mass.push_back(ball_mass);
+	matter.push_back(type);
+	flags.push_back(0);
+	impulse_x.push_back(0.0f);
+	impulse_y.push_back(0.0f);
+	handle.push_back((slot_generation[slot] << BALL_HANDLE_SLOT_BITS) | slot);
+	rest_x.push_back(pos.x);
+	rest_y.push_back(pos.y);
+	rest_steps.push_back(0);
+	return handle.back();
+}
+
+int BallStore::indexOf(BallHandle ball) const {
+	uint32_t slot = ball & BALL_HANDLE_SLOT_MASK;
+	if (ball == INVALID_BALL || slot >= slot_index.size() ||
+		slot_generation[slot] != (ball >> BALL_HANDLE_SLOT_BITS)) {
+		return -1;
+	}
+	return slot_index[slot];
+}
+
+int BallStore::compact() {
+	int count = size();
+	int removed = 0;
+	for (int i = 0; i < count;) {
+		if (!(flags[i] & BALL_REMOVED)) {
+			i++;
+			continue;
+		}
+		uint32_t slot = handle[i] & BALL_HANDLE_SLOT_MASK;
+		slot_index[slot] = -1;
+		slot_generation[slot] = (slot_generation[slot] + 1) & (0xFFFFFFFF >> BALL_HANDLE_SLOT_BITS);
+		free_slots.push_back(slot);
+		removed++;
+
+		// Fill the hole from the end and look at index i again, since the
+		// ball that moved in might be going too
+		count--;
+		if (i != count) {
+			pos_x[i] = pos_x[count];
+			pos_y[i] = pos_y[count];
+			prev_x[i] = prev_x[count];
+			prev_y[i] = prev_y[count];
+			vel_x[i] = vel_x[count];
+			vel_y[i] = vel_y[count];
+			mass[i] = mass[count];
+			matter[i] = matter[count];
+			flags[i] = flags[count];
+			impulse_x[i] = impulse_x[count];
+			impulse_y[i] = impulse_y[count];
+			handle[i] = handle[count];
+			rest_x[i] = rest_x[count];
+			rest_y[i] = rest_y[count];
+			rest_steps[i] = rest_steps[count];
+			slot_index[handle[i] & BALL_HANDLE_SLOT_MASK] = i;
+		}
+	}
+	pos_x.resize(count);
+	pos_y.resize(count);
+	prev_x.resize(count);
+	prev_y.resize(count);
+	vel_x.resize(count);
+	vel_y.resize(count);
+	mass.resize(count);
+	matter.resize(count);
+	flags.resize(count);
+	impulse_x.resize(count);
+	impulse_y.resize(count);
+	handle.resize(count);
+	rest_x.resize(count);
+	rest_y.resize(count);
+	rest_steps.resize(count);
+	return removed;
+}
+
+void BallStore::clear() {
+	pos_x.clear();
+	pos_y.clear();
+	prev_x.clear();
+	prev_y.clear();
+	vel_x.clear();
+	vel_y.clear();
+	mass.clear();
+	matter.clear();
+	flags.clear();
+	impulse_x.clear();
+	impulse_y.clear();
+	handle.clear();
+	rest_x.clear();
+	rest_y.clear();
+	rest_steps.clear();
+	slot_index.clear();
+	slot_generation.clear();
+	free_slots.clear();
+}
+
+float BallStore::kineticEnergy(int i) const {
+	return 0.5 * mass[i] * SqrMagnitude(getVelocity(i));
+}
+
+float BallStore::potentialEnergy(int i) const {
+	return Magnitude(ACCEL_GRAVITY) * mass[i] * (pos_y[i] + 1.0);
+}
+
+void BallStore::tickGravity(int i) {
+	Vec2 pos = getPos(i);
+	Vec2 velocity = getVelocity(i);
+
+	float d_time = PHYSICS_TIMESTEP;
+
+	// Do explosion impulses here out of sheer laziness
+	auto acceleration = ACCEL_GRAVITY + Vec2(impulse_x[i], impulse_y[i]);
+	impulse_x[i] = 0;
+	impulse_y[i] = 0;
+
+	Vec2 d_velocity =
+		(acceleration * d_time);
+
+	Vec2 d_position =
+		(velocity * d_time) + (acceleration * 0.5 * d_time * d_time);
+
+	velocity = velocity + d_velocity;
+	pos = pos + d_position;
+
+	pos_x[i] = pos.x;
+	pos_y[i] = pos.y;
+	vel_x[i] = velocity.x;
+	vel_y[i] = velocity.y;
+}
+
+void BallStore::collideWalls(int i, std::vector<SoundEvent>& sounds) {
+	const float BOTTOM = WALL_BOTTOM;
+	const float LEFT   = WALL_LEFT;
+	const float RIGHT  = WALL_RIGHT;
+
+	Vec2 pos = getPos(i);
+	Vec2 velocity = getVelocity(i);
+
+	const float ELASTICITY = WALL_ELASTICITY;
+
+	// Bottom wall
+	if ((pos.y - (BALL_SIZE / 2)) <= BOTTOM) {
+		// Displacement
+		float y_displace = BOTTOM - (pos.y - (BALL_SIZE / 2));
+		Vec2 n_displace = Norm(velocity) * -1;
+		Vec2 displace(n_displace.x / n_displace.y * y_displace, y_displace);
+		// Inelastic collision
+		Vec2 bounce_velocity(velocity.x * ELASTICITY, -velocity.y * ELASTICITY);
+
+		// Update
+		pos = pos + displace;
+		velocity = bounce_velocity;
+
+		if (Magnitude(velocity) > 0.5) {
+			sounds.push_back({ SOUND_THUMP, soundVolume(velocity), pos });
+		}
+	}
+
+	// Top wall
+	if ((pos.y + (BALL_SIZE / 2)) >= WALL_TOP) {
+		// Displacement
+		float y_displace = WALL_TOP - (pos.y + (BALL_SIZE / 2));
+		Vec2 n_displace = Norm(velocity) * -1;
+		Vec2 displace(n_displace.x / n_displace.y * y_displace, y_displace);
+		// Inelastic collision
+		Vec2 bounce_velocity(velocity.x * ELASTICITY, -velocity.y * ELASTICITY);
+
+		// Update
+		pos = pos + displace;
+		velocity = bounce_velocity;
+
+		if (Magnitude(velocity) > 0.5) {
+			sounds.push_back({ SOUND_THUMP, soundVolume(velocity), pos });
+		}
+	}
+
+	// Side walls
+	if ((pos.x - (BALL_SIZE / 2)) <= LEFT ||
+		(pos.x + (BALL_SIZE / 2)) >= RIGHT) {
+		// Displacement
+		float x_displace = ((pos.x - (BALL_SIZE / 2)) <= LEFT)
+			? (LEFT - (pos.x - (BALL_SIZE / 2)))
+			: (RIGHT - (pos.x + (BALL_SIZE / 2)));
+		Vec2 n_displace = Norm(velocity) * -1;
+		Vec2 displace(x_displace, n_displace.y / n_displace.x * x_displace);
+		// Inelastic collision
+		Vec2 bounce_velocity(-velocity.x * ELASTICITY, velocity.y * ELASTICITY);
+
+		// Update
+		pos = pos + displace;
+		velocity = bounce_velocity;
+
+		if (Magnitude(velocity) > 0.5) {
+			sounds.push_back({ SOUND_THUMP, soundVolume(velocity), pos });
+		}
+	}
+
+	pos_x[i] = pos.x;
+	pos_y[i] = pos.y;
+	vel_x[i] = velocity.x;
+	vel_y[i] = velocity.y;
+}
+
+Modification BallStore::collideBalls(int id, std::vector<SoundEvent>& sounds) const {
+	std::vector<int> everyone(size());
+	for (int i = 0; i < size(); i++) {
+		everyone[i] = i;
+	}
+	return collideBalls(id, everyone, sounds);
+}
+
+Modification BallStore::collideBalls(int id, const std::vector<int>& candidates, std::vector<SoundEvent>& sounds) const {
+	Vec2 velocity = getVelocity(id);
+
+	Vec2 total_acceleration(0, 0);
+	float total_energy_loss = 1.0;
+	bool annihilating = false;
+	for (int i : candidates) {
+		if (i == id) {
+			continue;
+		}
+
+		float d_x = pos_x[id] - pos_x[i];
+		float d_y = pos_y[id] - pos_y[i];
+		float distance_squared = d_x * d_x + d_y * d_y;
+		if (distance_squared > BALL_SIZE * BALL_SIZE) {
+			continue;
+		}
+
+		const MatterInteraction& interaction = MATTER_TABLE(matter[id], matter[i]);
+		annihilating = annihilating || interaction.annihilate;
+
+		// Overlap detected - add force
+		if (Magnitude(velocity) > 0.5) {
+			sounds.push_back({ SOUND_CLACK, soundVolume(velocity), getPos(id) });
+		}
+		if (distance_squared == 0) {
+			distance_squared = 0.01;
+		}
+		float accel_magnitude = interaction.repel / (distance_squared * mass[id]);
+		Vec2 force_normal = Norm(Vec2(d_x, d_y));
+		if (force_normal.x == 0 && force_normal.y == 0) {
+			force_normal = Vec2(-1.0, 0);
+		}
+		total_acceleration = total_acceleration + (force_normal * accel_magnitude);
+
+		// Energy loss
+		auto vel_normal = Normalize(velocity);
+		auto ball_vel_normal = Norm(getVelocity(i));
+		float dot = Dot(vel_normal, ball_vel_normal);
+		float energy_loss = sqrt((PI - acos(dot)) / PI) * interaction.elasticity;
+		if (std::isnan(energy_loss)) {
+			continue;
+		}
+		total_energy_loss *= energy_loss;
+	}
+
+	return { total_acceleration, total_energy_loss, annihilating, false };
+}
+
+void BallStore::cleanSlop(int i) {
+	if ((kineticEnergy(i) + potentialEnergy(i)) < SLOP_MAXIMUM) {
+		// Oppose slop with a small force
+		float amt = 0.9;
+		Vec2 velocity = getVelocity(i);
+		Vec2 slop_fighter = velocity * -1.0f * amt / PHYSICS_TIMESTEP;
+		velocity = slop_fighter * PHYSICS_TIMESTEP + velocity;
+		vel_x[i] = velocity.x;
+		vel_y[i] = velocity.y;
+	}
+}
+
+bool BallStore::findContact(int a, int b, Contact& contact) const {
+	float d_x = pos_x[a] - pos_x[b];
+	float d_y = pos_y[a] - pos_y[b];
+	float distance_squared = d_x * d_x + d_y * d_y;
+	if (distance_squared > BALL_SIZE * BALL_SIZE) {
+		return false;
+	}
+	float inverse_distance = fastRsqrt(distance_squared);
+	float distance = distance_squared * inverse_distance;
+	contact.a = a;
+	contact.b = b;
+	contact.normal = inverse_distance > 0 ? Vec2(d_x * inverse_distance, d_y * inverse_distance) : Vec2(-1.0, 0);
+	contact.depth = BALL_SIZE - distance;
+	contact.relative_velocity = getVelocity(a) - getVelocity(b);
+	const MatterInteraction& interaction = MATTER_TABLE(matter[a], matter[b]);
+	contact.repel = interaction.repel;
+	contact.annihilating = interaction.annihilate;
+	// The more head-on, the more it loses. A ball that isn't moving has no
+	// direction, which counts as side-on.
+	float dot = Dot(SafeNorm(getVelocity(a)), SafeNorm(getVelocity(b)));
+	contact.energy_loss = fmaxf(fastSqrt((PI - fastAcos(dot)) / PI) * interaction.elasticity, interaction.min_energy_kept);
+	return true;
+}
+
+//
+// StepClock
+//
+
+int StepClock::advance(float delta_time) {
+	accumulator += fmax(delta_time, 0.0f);
+	int steps = (int)(accumulator / PHYSICS_TIMESTEP);
+	if (steps > max_substeps) {
+		steps = max_substeps;
+		accumulator = fmod(accumulator, PHYSICS_TIMESTEP);
+	} else {
+		accumulator -= steps * PHYSICS_TIMESTEP;
+	}
+	// Rounding can leave it a hair over a whole step
+	accumulator = fmin(fmax(accumulator, 0.0f), PHYSICS_TIMESTEP);
+	return steps;
+}
+
+//
+// PointGrid
+//
+
+PointGrid::PointGrid(int dim) {
+	resize(dim);
+}
+
+int PointGrid::dimFor(float size) {
+	// One cell fewer than would fit at exactly `size`, so float rounding can
+	// never push two close points two cells apart
+	int dim = (int)ceil(2.0f / size) - 1;
+	return dim < 1 ? 1 : dim;
+}
+
+void PointGrid::resize(int new_dim) {
+	dim = new_dim;
+	cell_size = 2.0f / dim;
+}
+
+int PointGrid::cellCoord(float v) const {
+	// fmax/fmin also send NaN to the edge instead of into a bad cast
+	float cell = floor((v + 1.0f) / cell_size);
+	return (int)fmin(fmax(cell, 0.0f), (float)(dim - 1));
+}
+
+void PointGrid::rebuild(const float* x, const float* y, int count) {
+	cell_start.assign(dim * dim + 1, 0);
+	cell_points.resize(count);
+	point_cells.resize(count);
+	for (int i = 0; i < count; i++) {
+		point_cells[i] = cellOf(x[i], y[i]);
+		cell_start[point_cells[i] + 1]++;
+	}
+	for (int c = 0; c < dim * dim; c++) {
+		cell_start[c + 1] += cell_start[c];
+	}
+	// Counting sort, filling in index order so each cell stays ascending.
+	// cell_start[c] is used as cell c's fill cursor, which leaves it at the
+	// start of cell c + 1, so it's all shifted back up one after.
+	for (int i = 0; i < count; i++) {
+		cell_points[cell_start[point_cells[i]]++] = i;
+	}
+	for (int c = dim * dim; c > 0; c--) {
+		cell_start[c] = cell_start[c - 1];
+	}
+	cell_start[0] = 0;
+}
+
+void PointGrid::neighbours(int cell, std::vector<int>& out) const {
+	out.clear();
+	forEachNeighbour(cell, [&](int p) {
+		out.push_back(p);
+	});
+	std::sort(out.begin(), out.end());
+}
+
+//
+// Simulation
+//
+
+SpawnTuning::SpawnTuning() {
+	for (int i = 0; i < MATTER_COUNT; i++) {
+		base_chance_points[i] = MATTER_INFO[i].base_chance_points;
+		expected_proportions[i] = MATTER_INFO[i].expected_proportion;
+	}
+}
+
+Simulation::Simulation(uint32_t seed)
+	: grid(GRID_DIM), explosion_grid(1), thread_hits(1),
+	  kernel_level(detectKernelLevel()) {
+	// xorshift gets stuck on zero
+	rng_state = seed ^ 0x9E3779B9;
+	if (rng_state == 0) {
+		rng_state = 1;
+	}
+}
+
+void Simulation::setThreads(int threads) {
+	if (threads == 1) {
+		pool.reset();
+	} else {
+		pool.reset(new WorkerPool(threads));
+	}
+	thread_hits.resize(pool ? pool->threadCount() : 1);
+}
+
+void Simulation::runChunks(const std::function<void(int, int, int)>& fn) {
+	int count = balls.size();
+	// Only ever grows; shrinking would free the spare chunks' buffers when a
+	// few balls go up, only to allocate them again as more drop in
+	size_t chunks = (count + PHYSICS_CHUNK - 1) / PHYSICS_CHUNK;
+	if (chunks > chunk_sounds.size()) {
+		chunk_sounds.resize(chunks);
+		chunk_contacts.resize(chunks);
+	}
+	if (pool) {
+		pool->parallelFor(count, PHYSICS_CHUNK, fn);
+	} else {
+		for (int begin = 0; begin < count; begin += PHYSICS_CHUNK) {
+			fn(begin, std::min(begin + PHYSICS_CHUNK, count), 0);
+		}
+	}
+}
+
+void Simulation::gatherSounds() {
+	int count = sounds.size();
+	for (const auto& chunk : chunk_sounds) {
+		count += (int)chunk.size();
+	}
+	sounds.reserve(count);
+	for (auto& chunk : chunk_sounds) {
+		sounds.append(chunk.data(), (int)chunk.size());
+		chunk.clear();
+	}
+}
+
+void Simulation::wake(int i) {
+	balls.flags[i] &= ~(BALL_ASLEEP | BALL_DOZING);
+	balls.rest_x[i] = balls.pos_x[i];
+	balls.rest_y[i] = balls.pos_y[i];
+	balls.rest_steps[i] = 0;
+}
+
+void Simulation::updateSleep() {
+	const float drift_sqr = SLEEP_DRIFT * SLEEP_DRIFT;
+	// Smallest push that would get a ball past WAKE_SPEED in one step
+	const float impulse_sqr = (WAKE_SPEED * WAKE_SPEED) / (PHYSICS_TIMESTEP * PHYSICS_TIMESTEP);
+	forChunks([&](int begin, int end, int) {
+		for (int i = begin; i < end; i++) {
+			float impulse = balls.impulse_x[i] * balls.impulse_x[i] + balls.impulse_y[i] * balls.impulse_y[i];
+			if (balls.flags[i] & BALL_ASLEEP) {
+				// Sleep may have just been switched off
+				if (impulse > impulse_sqr || !allow_sleep) {
+					wake(i);
+				}
+				continue;
+			}
+			float d_x = balls.pos_x[i] - balls.rest_x[i];
+			float d_y = balls.pos_y[i] - balls.rest_y[i];
+			if (!allow_sleep || d_x * d_x + d_y * d_y > drift_sqr || impulse > impulse_sqr) {
+				wake(i);
+				continue;
+			}
+			if (balls.rest_steps[i] < 255) {
+				balls.rest_steps[i]++;
+			}
+		}
+	});
+}
+
+bool Simulation::heldUp(int i) const {
+	if (againstWall(balls.pos_x[i], balls.pos_y[i])) {
+		return true;
+	}
+	// Piles jitter a little apart as well as together. Only something
+	// that's settled itself holds a ball up; anything else might be on its
+	// way out from under it.
+	const float reach = BALL_SIZE + SLEEP_DRIFT;
+	bool held = false;
+	grid.forEachNeighbour(grid.point_cells[i], [&](int j) {
+		float d_x = balls.pos_x[i] - balls.pos_x[j];
+		float d_y = balls.pos_y[i] - balls.pos_y[j];
+		bool settled = (balls.flags[j] & BALL_ASLEEP) || balls.rest_steps[j] >= SLEEP_STEPS;
+		held = held || (j != i && settled && d_x * d_x + d_y * d_y <= reach * reach);
+	});
+	return held;
+}
+
+BallHandle Simulation::spawn(const SpawnCommand& command) {
+	//ball.velocity.x = 2.0f - 4.0f * (float)(rand() % 100) / 100.0f;
+	const float START_VELOCITY_SCALE = 0.2f;
+	Vec2 velocity(command.pos.x * -1.0f * START_VELOCITY_SCALE, 0);
+	ball_counts[(int)command.matter]++;
+	layout_version++;
+	return balls.add(command.matter, command.pos, velocity, 0.5);
+}
+
+void Simulation::reset() {
+	balls.clear();
+	contacts.clear();
+	resting_contacts.clear();
+	carried_contacts = 0;
+	for (int i = 0; i < MATTER_COUNT; i++) {
+		ball_counts[i] = 0;
+	}
+	awake_count = 0;
+	asleep_count = 0;
+	layout_version++;
+}
+
+void Simulation::reset(const BallStore& start) {
+	reset();
+	balls = start;
+	for (int i = 0; i < balls.size(); i++) {
+		ball_counts[(int)balls.matter[i]]++;
+	}
+}
+
+void Simulation::beginStep() {
+	arena.reset();
+	sounds = StepVector<SoundEvent>(arena);
+	contacts = StepVector<Contact>(arena);
+}
+
+void Simulation::step() {
+	PROFILE_SCOPE("step");
+	beginStep();
+	explosions.clear();
+	balls.prev_x = balls.pos_x;
+	balls.prev_y = balls.pos_y;
+
+	// Half the settled balls sit this step out, the other half the next
+	step_count++;
+	if (doze_settled && allow_sleep) {
+		forChunks([&](int begin, int end, int) {
+			for (int i = begin; i < end; i++) {
+				if (!(balls.flags[i] & BALL_ASLEEP) && balls.rest_steps[i] >= SLEEP_STEPS && ((i + step_count) & 1)) {
+					balls.flags[i] |= BALL_ASLEEP | BALL_DOZING;
+				}
+			}
+		});
+	}
+
+	// Apply gravity and wall collisions
+	{
+		PROFILE_SCOPE("integrate+walls");
+		forChunks([&](int begin, int end, int thread) {
+			auto& hits = thread_hits[thread];
+			hits.clear();
+			// Only the runs of awake balls; sleeping ones stay put
+			for (int run = begin; run < end;) {
+				if (balls.flags[run] & BALL_ASLEEP) {
+					run++;
+					continue;
+				}
+				int run_end = run + 1;
+				while (run_end < end && !(balls.flags[run_end] & BALL_ASLEEP)) {
+					run_end++;
+				}
+				integrateAndCollideWalls(kernel_level, balls, run, run_end, hits);
+				run = run_end;
+			}
+			auto& out = chunk_sounds[begin / PHYSICS_CHUNK];
+			for (auto& hit : hits) {
+				out.push_back({ SOUND_THUMP, hit.volume, balls.getPos(hit.ball) });
+			}
+		});
+		gatherSounds();
+	}
+
+	// Collide balls and detect annihilations
+	{
+		PROFILE_SCOPE("broadphase");
+		broadphase();
+	}
+	{
+		PROFILE_SCOPE("collide");
+		collide();
+	}
+	{
+		PROFILE_SCOPE("apply");
+		forChunks([&](int begin, int end, int) {
+			for (int i = begin; i < end; i++) {
+				const auto& acceleration = modifications[i].acceleration;
+				if (modifications[i].annihilating) {
+					balls.flags[i] |= BALL_ANNIHILATING;
+				}
+				float energy_loss = modifications[i].energy_loss;
+				// Apply accelerations
+				Vec2 velocity = acceleration * PHYSICS_TIMESTEP + balls.getVelocity(i);
+				// Apply energy loss
+				velocity = velocity * energy_loss;
+				balls.vel_x[i] = velocity.x;
+				balls.vel_y[i] = velocity.y;
+				// The velocity is left as it is; the wall code divides by it,
+				// so a woken ball can't start from exactly zero
+				if (modifications[i].can_sleep && balls.rest_steps[i] >= SLEEP_STEPS && heldUp(i)) {
+					balls.flags[i] |= BALL_ASLEEP;
+				}
+			}
+		});
+	}
+
+	// Annihilate pairs
+	{
+		PROFILE_SCOPE("annihilate");
+		annihilate();
+	}
+
+	// Clean up physics slop
+	{
+		PROFILE_SCOPE("slop");
+		forChunks([&](int begin, int end, int) {
+			for (int i = begin; i < end; i++) {
+				balls.cleanSlop(i);
+			}
+		});
+	}
+
+	// Add explosion impulses for next frame
+	{
+		PROFILE_SCOPE("explosions");
+		applyExplosions();
+	}
+
+	{
+		PROFILE_SCOPE("sleep");
+		// Dozers that nothing woke go back to being awake, settled balls
+		for (int i = 0; i < balls.size(); i++) {
+			if (balls.flags[i] & BALL_DOZING) {
+				balls.flags[i] &= ~(BALL_ASLEEP | BALL_DOZING);
+			}
+		}
+		updateSleep();
+		asleep_count = 0;
+		for (int i = 0; i < balls.size(); i++) {
+			asleep_count += (balls.flags[i] & BALL_ASLEEP) != 0;
+		}
+		awake_count = balls.size() - asleep_count;
+	}
+}
+
+void Simulation::broadphase() {
+	grid.rebuild(balls.pos_x.data(), balls.pos_y.data(), balls.size());
+}
+
+void Simulation::collide() {
+	// What only nearly touches a sleeper can hold it up too, without ever
+	// making a resting pair. An eighth of them a step look around for it.
+	for (int i = step_count % SUPPORT_CHECK_STEPS; i < balls.size(); i += SUPPORT_CHECK_STEPS) {
+		if ((balls.flags[i] & (BALL_ASLEEP | BALL_DOZING)) == BALL_ASLEEP && !heldUp(i)) {
+			wake(i);
+		}
+	}
+
+	// A sleeper is held up by whatever it was resting on. Once the end of a
+	// pair underneath it has gone or woken up, it wakes too, and so on up the
+	// pile, or it's left hanging where its support was. Whatever's beneath
+	// doesn't care what happens on top, so that can sleep on.
+	for (bool woke = true; woke;) {
+		woke = false;
+		for (const auto& resting : resting_contacts) {
+			int a = balls.indexOf(resting.a);
+			int b = balls.indexOf(resting.b);
+			if (a >= 0 && b >= 0 && balls.isResting(a) && balls.isResting(b)) {
+				continue;
+			}
+			for (int side = 0; side < 2; side++) {
+				int i = side == 0 ? a : b;
+				int other = side == 0 ? b : a;
+				if (i >= 0 && (balls.flags[i] & BALL_ASLEEP) && (other < 0 || balls.pos_y[other] < balls.pos_y[i])) {
+					wake(i);
+					woke = true;
+				}
+			}
+		}
+	}
+
+	// Everything but the resting pairs, first so `contacts` can be sized in
+	// one go. A pair of searching balls is taken by the lower index; a pair
+	// with a resting ball only the searching one sees. Straight off the grid
+	// cell by cell, which is an order that only depends on where the balls
+	// are, so the sums below still don't care how it was split up.
+	forChunks([&](int begin, int end, int) {
+		auto& out = chunk_contacts[begin / PHYSICS_CHUNK];
+		for (int i = begin; i < end; i++) {
+			if (balls.isResting(i)) {
+				continue;
+			}
+			grid.forEachNeighbour(grid.point_cells[i], [&](int j) {
+				if (j == i || (j < i && !balls.isResting(j))) {
+					return;
+				}
+				Contact contact;
+				if (balls.findContact(i, j, contact)) {
+					out.push_back(contact);
+				}
+			});
+		}
+	});
+
+	// Resting pairs pick up where they left off, ahead of the searched ones.
+	// Only their geometry can have changed; anything that woke searched for
+	// its own contacts above.
+	int searched = 0;
+	for (const auto& chunk : chunk_contacts) {
+		searched += (int)chunk.size();
+	}
+	contacts.clear();
+	contacts.reserve((int)resting_contacts.size() + searched);
+	for (const auto& resting : resting_contacts) {
+		int a = balls.indexOf(resting.a);
+		int b = balls.indexOf(resting.b);
+		if (a < 0 || b < 0 || !balls.isResting(a) || !balls.isResting(b)) {
+			continue;
+		}
+		// Two sleepers haven't moved, and nothing comes of them anyway
+		if ((balls.flags[a] & BALL_ASLEEP) && (balls.flags[b] & BALL_ASLEEP)) {
+			contacts.push_back(resting.contact);
+			contacts.back().a = a;
+			contacts.back().b = b;
+			continue;
+		}
+		Contact contact;
+		if (balls.findContact(a, b, contact)) {
+			contacts.push_back(contact);
+		}
+	}
+	carried_contacts = (int)contacts.size();
+	for (auto& chunk : chunk_contacts) {
+		contacts.append(chunk.data(), (int)chunk.size());
+		chunk.clear();
+	}
+
+	if (check_contacts) {
+		std::vector<int> seen(balls.size() * balls.size(), 0);
+		for (const auto& contact : contacts) {
+			seen[std::min(contact.a, contact.b) * balls.size() + std::max(contact.a, contact.b)]++;
+		}
+		for (int a = 0; a < balls.size(); a++) {
+			for (int b = a + 1; b < balls.size(); b++) {
+				int found = seen[a * balls.size() + b];
+				float d_x = balls.pos_x[a] - balls.pos_x[b];
+				float d_y = balls.pos_y[a] - balls.pos_y[b];
+				bool overlapping = d_x * d_x + d_y * d_y <= BALL_SIZE * BALL_SIZE;
+				bool searched = !balls.isResting(a) || !balls.isResting(b);
+				if (found > 1 || (overlapping && searched && found == 0)) {
+					contact_errors++;
+				}
+			}
+		}
+	}
+
+	// Both ends of every pair at once. Run in contact order on one thread,
+	// so the sums come out the same however the search was split up.
+	modifications = arena.alloc<Modification>(balls.size());
+	for (int i = 0; i < balls.size(); i++) {
+		bool asleep = balls.flags[i] & BALL_ASLEEP;
+		modifications[i] = { Vec2(0, 0), 1.0f, false, allow_sleep && !asleep };
+	}
+	// Each contact can wake at most both its balls
+	wakes = arena.alloc<BallWake>((int)contacts.size() * 2);
+	wake_count = 0;
+	for (const auto& contact : contacts) {
+		float distance = BALL_SIZE - contact.depth;
+		float distance_squared = distance > 0 ? distance * distance : 0.01f;
+		for (int side = 0; side < 2; side++) {
+			int ball = side == 0 ? contact.a : contact.b;
+			int other = side == 0 ? contact.b : contact.a;
+			// Sleeping balls still push back on awake ones, they just don't
+			// get pushed
+			if (balls.flags[ball] & BALL_ASLEEP) {
+				continue;
+			}
+			auto& modification = modifications[ball];
+			Vec2 velocity = balls.getVelocity(ball);
+			if (SqrMagnitude(velocity) > 0.5f * 0.5f) {
+				sounds.push_back({ SOUND_CLACK, soundVolume(velocity), balls.getPos(ball) });
+			}
+			float accel_magnitude = contact.repel / (distance_squared * balls.mass[ball]);
+			Vec2 force_normal = side == 0 ? contact.normal : contact.normal * -1.0f;
+			modification.acceleration = modification.acceleration + force_normal * accel_magnitude;
+			modification.energy_loss *= contact.energy_loss;
+			modification.annihilating = modification.annihilating || contact.annihilating;
+
+			if (!(balls.flags[other] & BALL_ASLEEP)) {
+				modification.can_sleep = modification.can_sleep && balls.rest_steps[other] >= SLEEP_STEPS;
+			}
+			// Something resting on a settled pile shouldn't keep stirring it up.
+			// The pile's own jitter overlaps its sleepers all the time, so
+			// only a real knock counts; what's taken out from under a
+			// sleeper wakes it above.
+			else if (contact.annihilating || SqrMagnitude(velocity) > WAKE_SPEED * WAKE_SPEED) {
+				wakes[wake_count++] = { other, contact.annihilating };
+			}
+		}
+	}
+
+	// Whatever's settled now will be resting next step unless something
+	// wakes it, which breaks the pair then. Taken before this step's wakes,
+	// so the sleepers on the far side of them hear about it.
+	resting_contacts.clear();
+	for (const auto& contact : contacts) {
+		int a = contact.a;
+		int b = contact.b;
+		bool settled_a = (balls.flags[a] & BALL_ASLEEP) || balls.rest_steps[a] >= SLEEP_STEPS;
+		bool settled_b = (balls.flags[b] & BALL_ASLEEP) || balls.rest_steps[b] >= SLEEP_STEPS;
+		if (settled_a && settled_b && allow_sleep) {
+			resting_contacts.push_back({ balls.handle[a], balls.handle[b], contact });
+		}
+	}
+
+	for (int w = 0; w < wake_count; w++) {
+		const BallWake& woken = wakes[w];
+		wake(woken.ball);
+		if (woken.annihilating) {
+			balls.flags[woken.ball] |= BALL_ANNIHILATING;
+		}
+	}
+}
+
+void Simulation::annihilate() {
+	for (int i = 0; i < balls.size(); i++) {
+		if (balls.flags[i] & BALL_ANNIHILATING) {
+			ball_counts[(int)balls.matter[i]]--;
+			explosions.push_back(balls.getPos(i));
+			balls.flags[i] |= BALL_REMOVED;
+			// Whatever was resting on it has lost its support
+			grid.forEachNeighbour(grid.point_cells[i], [&](int j) {
+				wake(j);
+			});
+		}
+	}
+	if (balls.compact() > 0) {
+		layout_version++;
+	}
+}
+
+static const float EXPLOSION_FORCE = 7.0f;
+
+// 1 inside the radius, easing down to 0 over the outer `fade` of it
+static float explosionFade(const ExplosionSettings& settings, float distance) {
+	if (settings.fade <= 0) {
+		return distance < settings.radius ? 1.0f : 0.0f;
+	}
+	float t = (settings.radius - distance) / (settings.fade * settings.radius);
+	t = fmin(fmax(t, 0.0f), 1.0f);
+	return t * t * (3 - 2 * t);
+}
+
+void Simulation::applyExplosions() {
+	if (explosions.empty()) {
+		forChunks([&](int begin, int end, int) {
+			std::fill(balls.impulse_x.begin() + begin, balls.impulse_x.begin() + end, 0.0f);
+			std::fill(balls.impulse_y.begin() + begin, balls.impulse_y.begin() + end, 0.0f);
+		});
+		return;
+	}
+
+	if (explosion.mode == EXPLOSION_EXACT) {
+		forChunks([&](int begin, int end, int) {
+			for (int i = begin; i < end; i++) {
+				Vec2 total_accel(0, 0);
+				for (auto& pos : explosions) {
+					auto difference = balls.getPos(i) - pos;
+					auto distance_sqr = SqrMagnitude(difference);
+					float inverse_distance = fastRsqrt(distance_sqr);
+					if (inverse_distance == 0) {
+						continue;
+					}
+					auto force_normal = difference * inverse_distance;
+					float force_scale = EXPLOSION_FORCE;
+					auto force = force_scale / distance_sqr;
+					auto acceleration = force / balls.mass[i];
+					total_accel = total_accel + (force_normal * acceleration);
+				}
+				balls.impulse_x[i] = total_accel.x;
+				balls.impulse_y[i] = total_accel.y;
+			}
+		});
+		return;
+	}
+
+	explosion_x = arena.alloc<float>((int)explosions.size());
+	explosion_y = arena.alloc<float>((int)explosions.size());
+	for (int e = 0; e < (int)explosions.size(); e++) {
+		explosion_x[e] = explosions[e].x;
+		explosion_y[e] = explosions[e].y;
+	}
+	explosion_grid.resize(PointGrid::dimFor(explosion.radius));
+	explosion_grid.rebuild(explosion_x.data(), explosion_y.data(), (int)explosions.size());
+	float radius_sqr = explosion.radius * explosion.radius;
+
+	if (explosion.mode == EXPLOSION_BOUNDED) {
+		forChunks([&](int begin, int end, int) {
+			for (int i = begin; i < end; i++) {
+				Vec2 pos = balls.getPos(i);
+				Vec2 total_accel(0, 0);
+				explosion_grid.forEachNeighbour(explosion_grid.cellOf(pos.x, pos.y), [&](int e) {
+					auto difference = pos - explosions[e];
+					auto distance_sqr = SqrMagnitude(difference);
+					float inverse_distance = fastRsqrt(distance_sqr);
+					if (inverse_distance == 0 || distance_sqr >= radius_sqr) {
+						return;
+					}
+					float distance = distance_sqr * inverse_distance;
+					auto force = EXPLOSION_FORCE / distance_sqr * explosionFade(explosion, distance);
+					auto acceleration = force / balls.mass[i];
+					total_accel = total_accel + (difference * inverse_distance) * acceleration;
+				});
+				balls.impulse_x[i] = total_accel.x;
+				balls.impulse_y[i] = total_accel.y;
+			}
+		});
+		return;
+	}
+
+	// EXPLOSION_FIELD splits 7/d^2 into a far part, 7/max(d, radius)^2, which
+	// is smooth enough to put on a coarse grid, and a near part, the rest,
+	// which is zero past the radius. Every explosion adds its far part into
+	// the field once...
+	int dim = std::max(explosion.field_dim, 2);
+	float spacing = 2.0f / (dim - 1);
+	explosion_field = arena.alloc<Vec2>(dim * dim);
+	for (int n = 0; n < dim * dim; n++) {
+		explosion_field[n] = Vec2(0, 0);
+	}
+	field_distance_sqr = arena.alloc<float>(dim * dim);
+	field_inverse_distance = arena.alloc<float>(dim * dim);
+	for (auto& pos : explosions) {
+		// Every node's distance at once, then all the square roots in one go.
+		// A node right on the explosion gets 0 and adds nothing.
+		for (int y = 0; y < dim; y++) {
+			for (int x = 0; x < dim; x++) {
+				field_distance_sqr[y * dim + x] = SqrMagnitude(Vec2(-1.0f + x * spacing, -1.0f + y * spacing) - pos);
+			}
+		}
+		fastRsqrtBatch(field_distance_sqr.data(), field_inverse_distance.data(), dim * dim);
+		for (int y = 0; y < dim; y++) {
+			for (int x = 0; x < dim; x++) {
+				Vec2 difference = Vec2(-1.0f + x * spacing, -1.0f + y * spacing) - pos;
+				float force = EXPLOSION_FORCE / fmax(field_distance_sqr[y * dim + x], radius_sqr);
+				explosion_field[y * dim + x] = explosion_field[y * dim + x] + difference * (field_inverse_distance[y * dim + x] * force);
+			}
+		}
+	}
+	// ...then every ball samples the field bilinearly and adds the near part
+	// of the explosions around it exactly
+	forChunks([&](int begin, int end, int) {
+		for (int i = begin; i < end; i++) {
+			Vec2 pos = balls.getPos(i);
+			float fx = fmin(fmax((pos.x + 1.0f) / spacing, 0.0f), (float)(dim - 1));
+			float fy = fmin(fmax((pos.y + 1.0f) / spacing, 0.0f), (float)(dim - 1));
+			int x0 = std::min((int)fx, dim - 2);
+			int y0 = std::min((int)fy, dim - 2);
+			float tx = fx - x0;
+			float ty = fy - y0;
+			Vec2 bottom = explosion_field[y0 * dim + x0] * (1 - tx) + explosion_field[y0 * dim + x0 + 1] * tx;
+			Vec2 top = explosion_field[(y0 + 1) * dim + x0] * (1 - tx) + explosion_field[(y0 + 1) * dim + x0 + 1] * tx;
+			Vec2 total_force = bottom * (1 - ty) + top * ty;
+
+			explosion_grid.forEachNeighbour(explosion_grid.cellOf(pos.x, pos.y), [&](int e) {
+				auto difference = pos - explosions[e];
+				auto distance_sqr = SqrMagnitude(difference);
+				float inverse_distance = fastRsqrt(distance_sqr);
+				if (inverse_distance == 0 || distance_sqr >= radius_sqr) {
+					return;
+				}
+				float force = EXPLOSION_FORCE / distance_sqr - EXPLOSION_FORCE / radius_sqr;
+				total_force = total_force + difference * (inverse_distance * force);
+			});
+
+			Vec2 accel = total_force / balls.mass[i];
+			balls.impulse_x[i] = accel.x;
+			balls.impulse_y[i] = accel.y;
+		}
+	});
+}
+
+uint32_t Simulation::random() {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+MatterType Simulation::pickMatter(const int* chance_points) {
+	int total_chance_points = 0;
+	for (int i = 0; i < MATTER_COUNT; i++) {
+		total_chance_points += chance_points[i];
+	}
+	float rand_value = (float)(random() % 1000) / 1000;
+	float boundary = 0;
+	for (int i = 0; i < MATTER_COUNT - 1; i++) {
+		boundary += (float)chance_points[i] / (float)total_chance_points;
+		if (rand_value < boundary) {
+			return (MatterType)i;
+		}
+	}
+	return (MatterType)(MATTER_COUNT - 1);
+}
+
+MatterType Simulation::whichBallNext() {
+	int total_balls = 0;
+	for (int i = 0; i < MATTER_COUNT; i++) {
+		total_balls += ball_counts[i];
+	}
+	int chance_points[MATTER_COUNT];
+	if (total_balls < 5) {
+		// Too small a sample for the complicated stuff, just pick randomly...
+		for (int i = 0; i < MATTER_COUNT; i++) {
+			chance_points[i] = MATTER_INFO[i].first_chance_points;
+		}
+		return pickMatter(chance_points);
+	}
+	for (int i = 0; i < MATTER_COUNT; i++) {
+		float proportion = (float) ball_counts[i] / (float) total_balls;
+		float delta = spawn_tuning.expected_proportions[i] - proportion;
+		// 2% -> 1 chance point
+		int point_delta = trunc(delta * 50.0f);
+		chance_points[i] = spawn_tuning.base_chance_points[i] + point_delta;
+		if (chance_points[i] < 0) {
+			chance_points[i] = 0;
+		}
+	}
+	return pickMatter(chance_points);
+}
+
+int Simulation::score() const {
+	int red  = ball_counts[RED_MATTER];
+	int blue = ball_counts[BLUE_MATTER];
+	if (red > blue) {
+		return blue;
+	} else {
+		return red;
+	}
+}
+
+static void hashBytes(uint64_t& hash, const void* data, size_t size) {
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+}
+
+uint64_t Simulation::checksum() const {
+	uint64_t hash = 14695981039346656037ull;
+	hashBytes(hash, balls.pos_x.data(), balls.pos_x.size() * sizeof(float));
+	hashBytes(hash, balls.pos_y.data(), balls.pos_y.size() * sizeof(float));
+	hashBytes(hash, balls.vel_x.data(), balls.vel_x.size() * sizeof(float));
+	hashBytes(hash, balls.vel_y.data(), balls.vel_y.size() * sizeof(float));
+	hashBytes(hash, balls.matter.data(), balls.matter.size() * sizeof(MatterType));
+	return hash;
+}
@@ -0,0 +1,436 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "Kernels.h"
+#include "Matter.h"
+#include "StepArena.h"
+#include "WorkerPool.h"
+
+// Headless physics core. Nothing in here knows about Dawn, FMOD or the window,
+// so it can be stepped and timed on a machine without a display. Game.cpp is
+// just a shell that feeds it clicks and draws/plays what comes out.
+
+static const float PI = 3.1415927;
+
+static const float PHYSICS_TIMESTEP = 1.0f / 60.0f;
+static const float BALL_SIZE = 0.2f;
+static const float SLOP_MAXIMUM = 0.05;
+
+struct Vec2 {
+	float x, y;
+	Vec2() : x(0), y(0) {}
+	Vec2(float x, float y) : x(x), y(y) {}
+};
+
+static inline Vec2 operator+(Vec2 a, Vec2 b) { return Vec2(a.x + b.x, a.y + b.y); }
+static inline Vec2 operator-(Vec2 a, Vec2 b) { return Vec2(a.x - b.x, a.y - b.y); }
+static inline Vec2 operator*(Vec2 a, float s) { return Vec2(a.x * s, a.y * s); }
+static inline Vec2 operator/(Vec2 a, float s) { return Vec2(a.x / s, a.y / s); }
+
+float SqrMagnitude(Vec2 vec);
+float Magnitude(Vec2 vec);
+float Dot(Vec2 a, Vec2 b);
+// Zero stays zero
+Vec2 Norm(Vec2 vec);
+// Zero turns into NaN, like Dawn::Normalize
+Vec2 Normalize(Vec2 vec);
+// Never NaN: zero, too small to measure, infinite or NaN all give zero
+Vec2 SafeNorm(Vec2 vec);
+
+static const Vec2 ACCEL_GRAVITY(0, -1.5);
+
+// The arena is the fixed square [-1, 1] x [-1, 1]
+static const float WALL_BOTTOM = -1.0f;
+static const float WALL_TOP    = +1.0f;
+static const float WALL_LEFT   = -1.0f;
+static const float WALL_RIGHT  = +1.0f;
+static const float WALL_ELASTICITY = 0.9;
+
+enum BallFlags {
+	BALL_ANNIHILATING = 1 << 0,
+	// Swapped out by the next BallStore::compact()
+	BALL_REMOVED      = 1 << 1,
+	// Settled; left out of integration and collision until something wakes it
+	BALL_ASLEEP       = 1 << 2,
+	// Asleep for this step only (see Simulation::doze_settled)
+	BALL_DOZING       = 1 << 3
+};
+
+// A ball that stays within SLEEP_DRIFT of one spot for SLEEP_STEPS steps has
+// settled, and goes to sleep once everything touching it has settled as well.
+// Drift rather than speed, since balls in a pile jitter back and forth under
+// the contact force while going nowhere.
+static const float SLEEP_DRIFT = 0.01f;
+static const int SLEEP_STEPS = 30;
+// Hitting a sleeping ball faster than this, or an explosion that would push
+// it this fast in one step, wakes it
+static const float WAKE_SPEED = 0.75f;
+// Sleepers check they're still held up once in this many steps
+static const int SUPPORT_CHECK_STEPS = 8;
+
+// On the floor, or up against a side wall, which puts a ball back along its
+// path when it hits and so can hold a slow one up as well
+static inline bool againstWall(float x, float y) {
+	const float reach = BALL_SIZE / 2 + SLEEP_DRIFT;
+	return y - reach <= WALL_BOTTOM || x - reach <= WALL_LEFT || x + reach >= WALL_RIGHT;
+}
+
+// Stays pointing at the same ball however the store gets shuffled. The low
+// bits are a slot, the high bits a generation so stale handles stop working.
+typedef uint32_t BallHandle;
+static const int BALL_HANDLE_SLOT_BITS = 20;
+static const uint32_t BALL_HANDLE_SLOT_MASK = (1u << BALL_HANDLE_SLOT_BITS) - 1;
+static const BallHandle INVALID_BALL = 0xFFFFFFFF;
+
+enum SoundType {
+	SOUND_CLACK,
+	SOUND_THUMP
+};
+
+struct SoundEvent {
+	SoundType type;
+	float volume;
+	// Where in the arena it happened
+	Vec2 pos;
+};
+
+// What one ball's collision pass wants done to it. Worked out read-only for
+// every ball first, then applied, so the balls can be split across threads.
+struct Modification {
+	Vec2 acceleration;
+	float energy_loss;
+	bool annihilating;
+	// Everything it touches has settled too, so it can go to sleep with them
+	bool can_sleep;
+};
+
+// Two overlapping balls. Found once per pair and applied to both, so the
+// expensive bits (the square root, the acos) aren't worked out twice.
+struct Contact {
+	int a, b;
+	// Unit vector from b towards a
+	Vec2 normal;
+	// How far the two overlap
+	float depth;
+	// a's velocity minus b's
+	Vec2 relative_velocity;
+	// What's kept of both balls' velocities after the knock
+	float energy_loss;
+	// From MATTER_TABLE
+	float repel;
+	bool annihilating;
+};
+
+// A sleeping ball that an awake one ran into
+struct BallWake {
+	int ball;
+	// Matter that annihilates, so it has to go up along with the one that
+	// woke it
+	bool annihilating;
+};
+
+// Structure-of-arrays ball store. The physics works straight on these columns;
+// whoever is drawing copies positions out once a frame. Balls are added at the
+// end and removed by swapping the last one into the hole, so indices move
+// around; hold on to a BallHandle to keep track of a particular ball.
+struct BallStore {
+	std::vector<float> pos_x;
+	std::vector<float> pos_y;
+	// Positions as of the start of the last step, for drawing in between
+	std::vector<float> prev_x;
+	std::vector<float> prev_y;
+	std::vector<float> vel_x;
+	std::vector<float> vel_y;
+	std::vector<float> mass;
+	std::vector<MatterType> matter;
+	std::vector<uint8_t> flags;
+	std::vector<float> impulse_x;
+	std::vector<float> impulse_y;
+	std::vector<BallHandle> handle;
+	// Where the ball has been resting since, and for how many steps
+	std::vector<float> rest_x;
+	std::vector<float> rest_y;
+	std::vector<uint8_t> rest_steps;
+
+	// Per slot: where that ball lives now, and the generation handed out with it
+	std::vector<int> slot_index;
+	std::vector<uint32_t> slot_generation;
+	std::vector<uint32_t> free_slots;
+
+	int size() const {
+		return (int)pos_x.size();
+	}
+	BallHandle add(MatterType type, Vec2 pos, Vec2 velocity, float ball_mass);
+	// -1 once the ball has gone
+	int indexOf(BallHandle ball) const;
+	// Swap-and-pops every ball flagged BALL_REMOVED in one go. Returns how
+	// many went.
+	int compact();
+	void clear();
+
+	Vec2 getPos(int i) const {
+		return Vec2(pos_x[i], pos_y[i]);
+	}
+	Vec2 getVelocity(int i) const {
+		return Vec2(vel_x[i], vel_y[i]);
+	}
+	// 0 is where the ball was before the last step, 1 where it is now
+	Vec2 getDrawPos(int i, float alpha) const {
+		return Vec2(prev_x[i] + (pos_x[i] - prev_x[i]) * alpha, prev_y[i] + (pos_y[i] - prev_y[i]) * alpha);
+	}
+	float kineticEnergy(int i) const;
+	float potentialEnergy(int i) const;
+
+	// Asleep, or settled for more than a step. Contacts between two resting
+	// balls are carried over from the last step instead of searched for.
+	bool isResting(int i) const {
+		return (flags[i] & BALL_ASLEEP) || rest_steps[i] > SLEEP_STEPS;
+	}
+
+	// Reference versions of what the kernels in Kernels.h do a run at a time
+	void tickGravity(int i);
+	void collideWalls(int i, std::vector<SoundEvent>& sounds);
+	// The old per-ball collision, which finds every pair from both sides.
+	// Brute force against every other ball.
+	Modification collideBalls(int id, std::vector<SoundEvent>& sounds) const;
+	// Only tests the balls listed in `candidates`, which must be in ascending
+	// order so the sums come out identical to the brute-force version
+	Modification collideBalls(int id, const std::vector<int>& candidates, std::vector<SoundEvent>& sounds) const;
+	// False if they don't overlap
+	bool findContact(int a, int b, Contact& contact) const;
+	void cleanSlop(int i);
+};
+
+// Uniform grid over the [-1, 1] arena, bucketing points by cell. Anything
+// outside the arena is clamped into the edge cells.
+struct PointGrid {
+	int dim;
+	float cell_size;
+	// Points sorted by cell; cell c owns cell_points[cell_start[c] .. cell_start[c + 1])
+	std::vector<int> cell_start;
+	std::vector<int> cell_points;
+	std::vector<int> point_cells;
+
+	PointGrid(int dim);
+	// Smallest grid whose cells are strictly wider than `size`, so two points
+	// closer than that are always in the same or neighbouring cells
+	static int dimFor(float size);
+
+	void resize(int new_dim);
+	int cellCoord(float v) const;
+	int cellOf(float x, float y) const {
+		return cellCoord(y) * dim + cellCoord(x);
+	}
+	void rebuild(const float* x, const float* y, int count);
+	// Every point in the 3x3 block of cells around `cell`, in ascending order
+	void neighbours(int cell, std::vector<int>& out) const;
+	// Same points, cell by cell, without gathering or sorting them
+	template<class F>
+	void forEachNeighbour(int cell, F fn) const {
+		int cx = cell % dim;
+		int cy = cell / dim;
+		for (int y = (cy > 0 ? cy - 1 : 0); y <= (cy < dim - 1 ? cy + 1 : dim - 1); y++) {
+			for (int x = (cx > 0 ? cx - 1 : 0); x <= (cx < dim - 1 ? cx + 1 : dim - 1); x++) {
+				int c = y * dim + x;
+				for (int p = cell_start[c]; p < cell_start[c + 1]; p++) {
+					fn(cell_points[p]);
+				}
+			}
+		}
+	}
+};
+
+// Broadphase cells are sized from BALL_SIZE, so any overlapping pair of balls
+// is always in neighbouring cells
+static const int GRID_DIM = PointGrid::dimFor(BALL_SIZE);
+
+// Turns variable frame times into whole physics steps. What's left over says
+// how far between the last two steps the frame should be drawn.
+struct StepClock {
+	float accumulator = 0;
+	// Past this many steps in one frame the extra time is dropped, so a slow
+	// frame (or the window being dragged) can't snowball into slower ones
+	int max_substeps = 4;
+
+	// How many steps to run for a frame that took `delta_time`
+	int advance(float delta_time);
+	float alpha() const {
+		return accumulator / PHYSICS_TIMESTEP;
+	}
+};
+
+struct SpawnCommand {
+	MatterType matter;
+	Vec2 pos;
+};
+
+// Balls per chunk when a pass is split up. Chunks are cut the same way with
+// or without threads, and per-chunk output is merged in chunk order, so the
+// parallel step gives exactly the same results as the serial one.
+static const int PHYSICS_CHUNK = 64;
+
+enum ExplosionMode {
+	// Every ball against every explosion, however far away
+	EXPLOSION_EXACT,
+	// Only explosions within `radius` of a ball, found through a grid, and
+	// nothing from further out
+	EXPLOSION_BOUNDED,
+	// Explosions further than `radius` are added into a coarse force field
+	// once, which balls sample; closer ones are summed exactly
+	EXPLOSION_FIELD
+};
+
+struct ExplosionSettings {
+	ExplosionMode mode = EXPLOSION_EXACT;
+	float radius = 0.4f;
+	// EXPLOSION_BOUNDED only: how much of the radius, at the outside edge, the
+	// push fades out over. 0 is a hard cutoff.
+	float fade = 0.5f;
+	// Nodes along each side of the EXPLOSION_FIELD force field
+	int field_dim = 17;
+};
+
+// How whichBallNext() keeps the colours balanced. Each colour starts from its
+// base chance points and gains one for every 2% it's short of its expected
+// share of the balls in play, or loses one for every 2% over.
+// By matter type
+struct SpawnTuning {
+	int base_chance_points[MATTER_COUNT];
+	float expected_proportions[MATTER_COUNT];
+	// MATTER_INFO's defaults
+	SpawnTuning();
+};
+
+class Simulation {
+	PointGrid grid;
+	PointGrid explosion_grid;
+	// Scratch that's only needed while a step runs. Comes out of `arena`,
+	// so it's gone at the next beginStep(), as are `sounds` and `contacts`.
+	// What's below that is kept from step to step instead: the per-thread
+	// and per-chunk buffers are filled in parallel and only grow, and
+	// resting_contacts has to outlive the step that found them.
+	StepArena arena;
+	StepArray<float> explosion_x;
+	StepArray<float> explosion_y;
+	StepArray<Vec2> explosion_field;
+	StepArray<float> field_distance_sqr;
+	StepArray<float> field_inverse_distance;
+	StepArray<Modification> modifications;
+	StepArray<BallWake> wakes;
+	int wake_count = 0;
+	uint32_t rng_state;
+	uint32_t step_count = 0;
+
+	std::unique_ptr<WorkerPool> pool;
+	std::vector<std::vector<WallHit>> thread_hits;
+	std::vector<std::vector<SoundEvent>> chunk_sounds;
+	std::vector<std::vector<Contact>> chunk_contacts;
+	// Contacts between balls that had settled, by handle, to be picked up
+	// again next step without searching
+	struct RestingContact {
+		BallHandle a, b;
+		Contact contact;
+	};
+	std::vector<RestingContact> resting_contacts;
+
+	// fn(begin, end, thread_index) over every chunk of balls. Only a
+	// reference to `fn` goes into the std::function, which is small enough
+	// not to need the heap however much the lambda captures.
+	template<class F>
+	void forChunks(const F& fn) {
+		runChunks([&fn](int begin, int end, int thread) {
+			fn(begin, end, thread);
+		});
+	}
+	void runChunks(const std::function<void(int, int, int)>& fn);
+	void gatherSounds();
+	void wake(int i);
+	// Tracks how long balls have been settled and wakes sleeping ones an
+	// explosion reaches
+	void updateSleep();
+	// Against a wall or a settled ball. Hanging at the top of a bounce, a
+	// ball can keep still long enough to settle with nothing under it.
+	bool heldUp(int i) const;
+	// One of each MatterType, weighted by `chance_points`
+	MatterType pickMatter(const int* chance_points);
+
+public:
+	BallStore balls;
+	// Filled in by the last step(). Out of the step arena, so they're only
+	// good until the next one starts.
+	StepVector<SoundEvent> sounds;
+	std::vector<Vec2> explosions;
+	// Every overlapping pair, each once. Any pair with a ball that isn't
+	// resting is searched for fresh; pairs of resting balls are carried over
+	// from the step before, so two resting balls that drift into each other
+	// (by less than SLEEP_DRIFT) aren't noticed until one of them wakes.
+	StepVector<Contact> contacts;
+	// How many of those were carried over
+	int carried_contacts = 0;
+
+	int ball_counts[MATTER_COUNT] = {};
+	// Bumped whenever balls are added or removed, so renderers know their
+	// per-ball state (colours etc.) needs redoing
+	uint32_t layout_version = 0;
+	// As of the end of the last step()
+	int awake_count = 0;
+	int asleep_count = 0;
+
+	Simulation(uint32_t seed);
+
+	// 1 runs the step on the calling thread, 0 uses every core
+	void setThreads(int threads);
+	// Defaults to detectKernelLevel()
+	KernelLevel kernel_level;
+	ExplosionSettings explosion;
+	SpawnTuning spawn_tuning;
+	// Let settled balls drop out of the step
+	bool allow_sleep = true;
+	// Cheaper still: balls that have settled but can't sleep yet, because
+	// something they touch hasn't, are treated as asleep every other step
+	bool doze_settled = false;
+	// Runs an O(n^2) pass alongside the contact search and counts every pair
+	// it missed or found twice in contact_errors. For `headless check`.
+	bool check_contacts = false;
+	int contact_errors = 0;
+
+	BallHandle spawn(const SpawnCommand& command);
+	void reset();
+	// Starts over from `start` rather than an empty arena, e.g. a generated
+	// scene, with the ball counts to match
+	void reset(const BallStore& start);
+	void step();
+	// Drops the last step's scratch. step() starts with it; call it before
+	// running the parts below by hand.
+	void beginStep();
+	// Step scratch high-water mark and heap allocations
+	const StepArena& stepArena() const {
+		return arena;
+	}
+	// The parts of step() that Bench.cpp times on their own. broadphase()
+	// buckets the balls as they are now. collide() fills `contacts` and works
+	// out what they do to each ball, waking any sleepers they disturb.
+	// annihilate() removes every ball flagged BALL_ANNIHILATING, leaving an
+	// explosion where it was. Both need broadphase() to have seen the balls
+	// first.
+	void broadphase();
+	void collide();
+	void annihilate();
+	// The last part of step(): sets every ball's impulse_x/y from `explosions`
+	void applyExplosions();
+
+	// Steps run since the simulation was made, resets included
+	uint32_t stepCount() const {
+		return step_count;
+	}
+
+	uint32_t random();
+	MatterType whichBallNext();
+	int score() const;
+	// FNV-1a over the full ball state, for checking two runs ended up the same
+	uint64_t checksum() const;
+};
@@ -0,0 +1,72 @@
+#include "SoundQueue.h"
+
+#include <algorithm>
+#include <cmath>
+
+void SoundQueue::push(const SoundEvent* events, int count) {
+	pending.insert(pending.end(), events, events + count);
+}
+
+void SoundQueue::flush(std::vector<SoundEvent>& out) {
+	out.clear();
+	last_pushed = (int)pending.size();
+
+	// Bucket by type and merge cell...
+	int cells = std::max((int)ceil(2.0f / merge_size), 1);
+	auto key = [&](const SoundEvent& event) {
+		int x = (int)fmin(fmax(floor((event.pos.x + 1.0f) / merge_size), 0.0f), (float)(cells - 1));
+		int y = (int)fmin(fmax(floor((event.pos.y + 1.0f) / merge_size), 0.0f), (float)(cells - 1));
+		return ((int)event.type * cells + y) * cells + x;
+	};
+	// Counted into place like PointGrid does, keeping the order they were
+	// raised in within a bucket
+	int buckets = (SOUND_THUMP + 1) * cells * cells;
+	keys.resize(pending.size());
+	bucket_end.assign(buckets + 1, 0);
+	for (size_t i = 0; i < pending.size(); i++) {
+		keys[i] = key(pending[i]);
+		bucket_end[keys[i] + 1]++;
+	}
+	for (int b = 0; b < buckets; b++) {
+		bucket_end[b + 1] += bucket_end[b];
+	}
+	// Leaves each bucket_end[b] where bucket b ends
+	sorted.resize(pending.size());
+	for (size_t i = 0; i < pending.size(); i++) {
+		sorted[bucket_end[keys[i]]++] = pending[i];
+	}
+	pending.clear();
+
+	// ...and turn each bucket into one sound. Volumes add like energy, so ten
+	// quiet clacks come out louder than one but never past full volume.
+	int begin = 0;
+	for (int b = 0; b < buckets; b++) {
+		int end = bucket_end[b];
+		if (begin == end) {
+			continue;
+		}
+		float energy = 0;
+		float weight = 0;
+		Vec2 pos(0, 0);
+		for (int i = begin; i < end; i++) {
+			const auto& event = sorted[i];
+			energy += event.volume * event.volume;
+			weight += event.volume;
+			pos = pos + event.pos * event.volume;
+		}
+		SoundEvent merged;
+		merged.type = sorted[begin].type;
+		merged.volume = fmin(sqrt(energy), 1.0f);
+		merged.pos = weight > 0 ? pos / weight : sorted[begin].pos;
+		out.push_back(merged);
+		begin = end;
+	}
+
+	if ((int)out.size() > voice_budget) {
+		std::partial_sort(out.begin(), out.begin() + voice_budget, out.end(), [](const SoundEvent& a, const SoundEvent& b) {
+			return a.volume > b.volume;
+		});
+		out.resize(voice_budget);
+	}
+	last_played = (int)out.size();
+}
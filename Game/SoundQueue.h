@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Simulation.h"
+
+#include <vector>
+
+// Collects a frame's worth of sound events from however many physics steps
+// ran, then merges and trims them before anything goes near FMOD. A pile-up
+// can raise hundreds of clacks a step; what comes out of flush() is at most
+// `voice_budget` sounds.
+class SoundQueue {
+	std::vector<SoundEvent> pending;
+	// flush()'s scratch. Kept between frames, so once they've seen the
+	// busiest one merging doesn't allocate.
+	std::vector<int> keys;
+	std::vector<int> bucket_end;
+	std::vector<SoundEvent> sorted;
+
+public:
+	// Events of the same type closer together than this become one sound
+	float merge_size = 0.25f;
+	// Most sounds started per frame. The loudest win.
+	int voice_budget = 16;
+
+	// What the last flush() took in and gave out
+	int last_pushed = 0;
+	int last_played = 0;
+
+	void push(const SoundEvent* events, int count);
+	// Merges the pending events by type and location, keeps the loudest
+	// `voice_budget` of them in `out` and empties the queue
+	void flush(std::vector<SoundEvent>& out);
+};
@@ -0,0 +1,75 @@
+#include "StepArena.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+StepArena::StepArena(size_t first_block) {
+	blocks.push_back({ std::unique_ptr<uint8_t[]>(new uint8_t[first_block]), first_block });
+}
+
+size_t StepArena::capacity() const {
+	size_t total = 0;
+	for (const auto& b : blocks) {
+		total += b.size;
+	}
+	return total;
+}
+
+void* StepArena::allocate(size_t bytes, size_t align) {
+	while (true) {
+		Block& current = blocks[block];
+		size_t start = (offset + align - 1) & ~(align - 1);
+		if (start + bytes <= current.size) {
+			used += start - offset + bytes;
+			offset = start + bytes;
+			if (used > high_water) {
+				high_water = used;
+			}
+			return current.memory.get() + start;
+		}
+		// The rest of this block goes to waste until reset()
+		used += current.size - offset;
+		block++;
+		offset = 0;
+		if (block == blocks.size()) {
+			size_t size = blocks.back().size * 2;
+			while (size < bytes + align) {
+				size *= 2;
+			}
+			blocks.push_back({ std::unique_ptr<uint8_t[]>(new uint8_t[size]), size });
+			heap_allocations++;
+		}
+	}
+}
+
+void StepArena::reset() {
+#if CHECK_ARENA
+	for (size_t i = 0; i <= block && i < blocks.size(); i++) {
+		memset(blocks[i].memory.get(), 0xFF, i < block ? blocks[i].size : offset);
+	}
+#endif
+	last_used = used;
+	last_heap_allocations = heap_allocations;
+	total_heap_allocations += heap_allocations;
+	heap_allocations = 0;
+	// One block big enough for everything, so the next step like this one
+	// fits without going back to the heap. That counts against the next step.
+	if (blocks.size() > 1) {
+		size_t size = capacity();
+		blocks.clear();
+		blocks.push_back({ std::unique_ptr<uint8_t[]>(new uint8_t[size]), size });
+		heap_allocations = 1;
+	}
+	block = 0;
+	offset = 0;
+	used = 0;
+	generation++;
+}
+
+#if CHECK_ARENA
+void reportArenaEscape(uint32_t array_generation, uint32_t arena_generation) {
+	printf("Arena memory from step %u used in step %u\n", array_generation, arena_generation);
+	abort();
+}
+#endif
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for what a physics step needs only while it runs. reset()
+// at the start of the next step drops the lot in one go; there's no freeing
+// anything on its own. Once a step has needed more than one block, the next
+// reset() swaps them for a single block that big, so from then on a step
+// normally doesn't touch the heap at all.
+
+// Every StepArray checks on each access that its step is still the current
+// one, and reset() fills the old step's memory with 0xFF (NaN as floats)
+#define CHECK_ARENA 0
+
+class StepArena;
+
+// `count` Ts out of the arena, left uninitialised. Only good until the
+// arena's next reset().
+template<class T>
+struct StepArray {
+	T* items = nullptr;
+	int count = 0;
+#if CHECK_ARENA
+	const StepArena* arena = nullptr;
+	uint32_t generation = 0;
+	void check() const;
+#endif
+
+	T& operator[](int i) const {
+#if CHECK_ARENA
+		check();
+#endif
+		return items[i];
+	}
+	T* data() const {
+#if CHECK_ARENA
+		check();
+#endif
+		return items;
+	}
+	int size() const {
+		return count;
+	}
+};
+
+class StepArena {
+	struct Block {
+		std::unique_ptr<uint8_t[]> memory;
+		size_t size;
+	};
+	std::vector<Block> blocks;
+	// Where the next allocation goes: which block, and how far into it
+	size_t block = 0;
+	size_t offset = 0;
+	// Everything handed out since reset(), in bytes, padding included
+	size_t used = 0;
+	uint32_t generation = 0;
+	int heap_allocations = 0;
+
+	void* allocate(size_t bytes, size_t align);
+
+public:
+	// Most the arena has held at once, over every step so far
+	size_t high_water = 0;
+	// How much the last step took, and how many blocks it had to get from
+	// the heap to do it
+	size_t last_used = 0;
+	int last_heap_allocations = 0;
+	// Heap allocations over every step so far
+	uint64_t total_heap_allocations = 0;
+
+	StepArena(size_t first_block = 64 * 1024);
+	StepArena(const StepArena&) = delete;
+	StepArena& operator=(const StepArena&) = delete;
+
+	void reset();
+	uint32_t currentGeneration() const {
+		return generation;
+	}
+	// Bytes it can hold without going back to the heap
+	size_t capacity() const;
+
+	template<class T>
+	StepArray<T> alloc(int count) {
+		static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destructed");
+		StepArray<T> array;
+		array.items = (T*)allocate(sizeof(T) * (count > 0 ? count : 0), alignof(T));
+		array.count = count;
+#if CHECK_ARENA
+		array.arena = this;
+		array.generation = generation;
+#endif
+		return array;
+	}
+};
+
+// A StepArray that can be added to, for when how many isn't known up front.
+// Outgrowing it takes a run twice as long out of the arena and copies across;
+// the old run just sits there until reset(), so reserve() when the count can
+// be worked out first. Bound to the arena it came from and only good until
+// that's reset, like any StepArray.
+template<class T>
+class StepVector {
+	static_assert(std::is_trivially_copyable<T>::value, "grown by memcpy");
+	StepArena* arena = nullptr;
+	StepArray<T> items;
+	int used = 0;
+
+public:
+	StepVector() {}
+	explicit StepVector(StepArena& arena) : arena(&arena) {}
+
+	void reserve(int capacity) {
+		if (capacity <= items.size()) {
+			return;
+		}
+		StepArray<T> bigger = arena->alloc<T>(capacity);
+		if (used > 0) {
+			memcpy(bigger.data(), items.data(), sizeof(T) * used);
+		}
+		items = bigger;
+	}
+	void push_back(const T& item) {
+		if (used == items.size()) {
+			reserve(used < 16 ? 32 : used * 2);
+		}
+		items[used++] = item;
+	}
+	void append(const T* from, int count) {
+		reserve(used + count);
+		if (count > 0) {
+			memcpy(items.data() + used, from, sizeof(T) * count);
+		}
+		used += count;
+	}
+	void clear() {
+		used = 0;
+	}
+	int size() const {
+		return used;
+	}
+	bool empty() const {
+		return used == 0;
+	}
+	T& operator[](int i) const {
+		return items[i];
+	}
+	T& back() const {
+		return items[used - 1];
+	}
+	T* begin() const {
+		return items.data();
+	}
+	T* end() const {
+		return items.data() + used;
+	}
+};
+
+#if CHECK_ARENA
+void reportArenaEscape(uint32_t array_generation, uint32_t arena_generation);
+
+template<class T>
+void StepArray<T>::check() const {
+	if (arena && generation != arena->currentGeneration()) {
+		reportArenaEscape(generation, arena->currentGeneration());
+	}
+}
+#endif
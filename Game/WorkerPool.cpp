@@ -0,0 +1,91 @@
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(int threads) {
+	thread_count = threads > 0 ? threads : (int)std::thread::hardware_concurrency();
+	if (thread_count < 1) {
+		thread_count = 1;
+	}
+	queues.reset(new Queue[thread_count]);
+	for (int i = 0; i < thread_count; i++) {
+		queues[i].next = 0;
+		queues[i].end = 0;
+	}
+	for (int i = 1; i < thread_count; i++) {
+		this->threads.emplace_back(&WorkerPool::workerMain, this, i);
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quitting = true;
+	}
+	wake.notify_all();
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+void WorkerPool::workerMain(int index) {
+	uint64_t seen = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return quitting || generation != seen; });
+			if (quitting) {
+				return;
+			}
+			seen = generation;
+		}
+		runChunks(index);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--running == 0) {
+				done.notify_one();
+			}
+		}
+	}
+}
+
+void WorkerPool::runChunks(int index) {
+	// Own queue first, then go round the others stealing
+	for (int v = 0; v < thread_count; v++) {
+		Queue& queue = queues[(index + v) % thread_count];
+		int chunk;
+		while ((chunk = queue.next.fetch_add(1)) < queue.end) {
+			int begin = chunk * job_chunk;
+			int end = begin + job_chunk < job_count ? begin + job_chunk : job_count;
+			(*job)(begin, end, index);
+		}
+	}
+}
+
+void WorkerPool::parallelFor(int count, int chunk_size, const std::function<void(int, int, int)>& fn) {
+	if (count <= 0) {
+		return;
+	}
+	int chunks = (count + chunk_size - 1) / chunk_size;
+	if (thread_count == 1 || chunks == 1) {
+		for (int begin = 0; begin < count; begin += chunk_size) {
+			fn(begin, begin + chunk_size < count ? begin + chunk_size : count, 0);
+		}
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &fn;
+		job_count = count;
+		job_chunk = chunk_size;
+		for (int i = 0; i < thread_count; i++) {
+			queues[i].next = (int)((int64_t)chunks * i / thread_count);
+			queues[i].end  = (int)((int64_t)chunks * (i + 1) / thread_count);
+		}
+		running = thread_count - 1;
+		generation++;
+	}
+	wake.notify_all();
+	runChunks(0);
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [&] { return running == 0; });
+	job = nullptr;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads for splitting the physics passes over ball
+// ranges. parallelFor() cuts the range into chunks and deals every thread an
+// equal run of them; a thread that finishes its own run steals chunks off the
+// others. The calling thread works too, as thread 0.
+class WorkerPool {
+	struct Queue {
+		std::atomic<int> next;
+		int end;
+	};
+
+	std::vector<std::thread> threads;
+	std::unique_ptr<Queue[]> queues;
+	int thread_count;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	uint64_t generation = 0;
+	int running = 0;
+	bool quitting = false;
+
+	const std::function<void(int, int, int)>* job = nullptr;
+	int job_count = 0;
+	int job_chunk = 0;
+
+	void workerMain(int index);
+	void runChunks(int index);
+
+public:
+	// 0 threads means one per core
+	WorkerPool(int threads);
+	~WorkerPool();
+
+	int threadCount() const {
+		return thread_count;
+	}
+	// Calls fn(begin, end, thread_index) over [0, count) in chunk_size pieces
+	// and returns once they've all been run
+	void parallelFor(int count, int chunk_size, const std::function<void(int, int, int)>& fn);
+};